@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+/**
+ * Correction of the RP2040 ADC differential non-linearity
+ *
+ * The ADC has wide codes at 512, 1536, 2560 and 3584 (see RP2040-E11),
+ * every code above a wide one reads low by its extra width.
+ * The correction is described by the extra width of each of them,
+ * and expanded into a lookup table so a sample costs a single load.
+ */
+namespace AdcCorrection
+{
+    constexpr uint16_t SPIKE_CODES[] = {512, 1536, 2560, 3584};
+    constexpr uint8_t SPIKE_COUNT = sizeof(SPIKE_CODES) / sizeof(SPIKE_CODES[0]);
+    constexpr uint8_t WIDTH_FRAC_BITS = 4; // The widths are in 1/16 LSB
+
+    /** Raw code to corrected code, in RAM since random reads from XIP flash would miss the cache */
+    extern uint16_t table[1 << 12];
+
+    /**
+     * @brief Correct a raw ADC code
+     *
+     * @param code The raw 12-bit code
+     * @return The code in ideal LSBs, which can exceed 4095
+     */
+    inline uint16_t apply(const uint16_t code)
+    {
+        return table[code & 0xFFF];
+    }
+
+    /**
+     * @brief Set the extra widths of the wide codes and rebuild the table
+     *
+     * @param widths The extra width of each code in SPIKE_CODES, in 1/16 LSB
+     */
+    void setSpikeWidths(const int16_t widths[SPIKE_COUNT]);
+
+    /**
+     * @brief Start collecting the code histogram around the wide codes
+     *
+     * A slow ramp covering the full ADC range should be applied meanwhile
+     */
+    void startCapture();
+
+    /**
+     * @brief Count the raw samples of a channel in a block
+     *
+     * @param block The interleaved sample block
+     * @param channel The position of the channel in the block
+     * @param channelCount The number of channels interleaved in the block
+     */
+    void feedCapture(std::span<const uint16_t> block, const size_t channel, const size_t channelCount);
+
+    /**
+     * @brief Calculate the extra widths from the histogram
+     *
+     * Each code of an ideal ADC is hit equally often by a linear ramp,
+     * so the width of a code is its hit count over the average of its neighbours.
+     *
+     * @param widths Output, the extra width of each code in SPIKE_CODES, in 1/16 LSB
+     * @return true if enough samples were collected around every wide code
+     */
+    bool finishCapture(int16_t widths[SPIKE_COUNT]);
+
+} // namespace AdcCorrection
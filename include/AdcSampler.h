@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+namespace AdcSampler
+{
+    /** Number of ADC inputs converted in round-robin, in the order of their input number */
+    constexpr uint8_t CHANNEL_COUNT = 2;
+
+    /**
+     * @brief Initialize the ADC and the DMA channels, and start the acquisition
+     *
+     * The ADC converts USENSE_PIN and ISENSE_PIN in round-robin mode,
+     * the results are moved from the FIFO into 2 sample blocks by a ping-pong DMA pair,
+     * so no CPU time is spent on each sample.
+     *
+     * @param sampleRate Total conversions per second, shared by all channels (up to 500k)
+     */
+    void init(const uint32_t sampleRate);
+
+    /**
+     * @brief Get the next full sample block
+     *
+     * The samples of the channels are interleaved, starting with the lowest ADC input.
+     * The block stays valid until the DMA wraps back to it, i.e. for one block period,
+     * so it should be processed before the next call.
+     *
+     * @return The sample block, or an empty span if no new block is ready
+     */
+    std::span<const uint16_t> getBlock();
+
+    /**
+     * @brief Get the number of samples converted after the last block returned by getBlock()
+     *
+     * Those of the blocks completed meanwhile, and those already in the block being written by the DMA.
+     *
+     * @return The count of samples of all the channels, 0 if the acquisition isn't running
+     */
+    uint32_t getSamplesAhead();
+
+    /**
+     * @brief Get the number of blocks which were overwritten before being processed
+     *
+     * @return The count of dropped blocks
+     */
+    uint32_t getDroppedBlocks();
+
+    /**
+     * @brief Stop the acquisition, e.g. while the interrupts are off for longer than a block period
+     *
+     * The finished channel is re-armed by the DMA interrupt, without it the DMA would write past the blocks.
+     * The samples converted until resume() are lost, and not counted as dropped.
+     */
+    void pause();
+
+    /**
+     * @brief Restart the acquisition after pause(), into the block expected by getBlock()
+     */
+    void resume();
+
+} // namespace AdcSampler
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace Benchmark
+{
+    /**
+     * @brief Register the benchmark commands
+     *
+     * Only available when built with METER_BENCHMARK, see the pico_bench environment
+     */
+    void init();
+
+} // namespace Benchmark
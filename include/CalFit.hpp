@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include "AdcCorrection.h"
+#include "Calibration.hpp"
+#include "config.h"
+#include "FixedPoint.hpp"
+
+/**
+ * Automated calibration: settled reference points and a least-squares line through them
+ *
+ * Not on the sample path, so in double precision for the sums of squares.
+ */
+
+/**
+ * @brief Running mean and variance by Welford's method
+ */
+class RunningStats
+{
+private:
+    uint32_t n = 0;
+    double m = 0;
+    double m2 = 0; // Sum of the squared deviations from the mean
+
+public:
+    void clear()
+    {
+        n = 0;
+        m = 0;
+        m2 = 0;
+    }
+
+    void push(const double x)
+    {
+        n++;
+        auto delta = x - m;
+        m += delta / n;
+        m2 += delta * (x - m);
+    }
+
+    inline uint32_t count() const
+    {
+        return n;
+    }
+
+    inline double mean() const
+    {
+        return m;
+    }
+
+    /** Sample variance */
+    inline double variance() const
+    {
+        return n > 1 ? m2 / (n - 1) : 0;
+    }
+
+    inline double stddev() const
+    {
+        return std::sqrt(variance());
+    }
+};
+
+/**
+ * @brief Collects the block means of a channel for a reference point, and tells whether the input had settled
+ *
+ * The block means are independent of the meter filter, so their spread is the actual noise.
+ * The point is settled if the spread and the difference between the means of both halves are small enough.
+ */
+class PointCollector
+{
+public:
+    enum class Verdict : uint8_t
+    {
+        SETTLED,
+        NOISY,
+        DRIFTING,
+        OVERLOAD,
+    };
+
+private:
+    RunningStats halves[2];
+    RunningStats all;
+    uint32_t target = 0;
+    bool active = false;
+    bool overloaded = false;
+
+public:
+    int32_t value = 0; // The reference, at the ADC input side, e.g. across the sample resistor
+    uint8_t scale = 0;
+
+    /**
+     * @brief Start collecting a point
+     *
+     * @param samples The number of blocks
+     */
+    void start(const uint32_t samples)
+    {
+        halves[0].clear();
+        halves[1].clear();
+        all.clear();
+        target = samples;
+        overloaded = false;
+        active = true;
+    }
+
+    void cancel()
+    {
+        active = false;
+    }
+
+    inline bool isActive() const
+    {
+        return active;
+    }
+
+    /**
+     * @brief Take the samples of a channel in a block
+     *
+     * @param block The interleaved sample block
+     * @param channel The position of the channel in the block
+     * @param channelCount The number of channels interleaved in the block
+     * @return true when the point is complete
+     */
+    bool pushBlock(std::span<const uint16_t> block, const std::size_t channel, const std::size_t channelCount)
+    {
+        if (!active)
+            return false;
+
+        uint32_t sum = 0;
+        uint32_t n = 0;
+        for (auto i = channel; i < block.size(); i += channelCount, n++)
+        {
+            sum += AdcCorrection::apply(block[i]);
+            overloaded |= block[i] >= ADC_SATURATION_CODE;
+        }
+        if (!n)
+            return false;
+
+        auto uv = FixedPoint::codeToMicrovolts((static_cast<uint64_t>(sum) << FixedPoint::FRAC_BITS) / n);
+        all.push(uv);
+        halves[all.count() * 2 > target].push(uv);
+        if (all.count() < target)
+            return false;
+
+        active = false;
+        return true;
+    }
+
+    /**
+     * @brief Judge the collected point
+     *
+     * @param maxNoise The largest standard deviation of the block means, in microvolts
+     * @param maxDrift The largest difference between the means of both halves, in microvolts
+     */
+    Verdict verdict(const double maxNoise, const double maxDrift) const
+    {
+        if (overloaded)
+            return Verdict::OVERLOAD;
+        // A ramp also shows as noise
+        if (std::fabs(drift()) > maxDrift)
+            return Verdict::DRIFTING;
+        if (all.stddev() > maxNoise)
+            return Verdict::NOISY;
+        return Verdict::SETTLED;
+    }
+
+    /** The mean at the ADC pin in microvolts */
+    inline double mean() const
+    {
+        return all.mean();
+    }
+
+    /** The standard deviation of the block means in microvolts */
+    inline double noise() const
+    {
+        return all.stddev();
+    }
+
+    /** The change of the mean from the first half to the second one in microvolts */
+    inline double drift() const
+    {
+        return halves[1].mean() - halves[0].mean();
+    }
+
+    inline uint32_t count() const
+    {
+        return all.count();
+    }
+};
+
+/**
+ * @brief Least-squares line through the reference points of a scale
+ *
+ * The reference values are taken as exact and the pin voltages as measured, so the fit is
+ * raw = gain * value + offset. A single point fits the gain only.
+ */
+class LineFit
+{
+public:
+    static constexpr uint8_t MAX_POINTS = 8;
+
+    struct Point
+    {
+        double raw;   // Mean pin voltage in microvolts
+        double value; // Reference at the ADC input side in micro-units
+        double noise; // Standard error of the mean pin voltage
+    };
+
+    struct Result
+    {
+        double gain;   // Pin voltage per input unit, as ScaleCalibration::gain()
+        double offset; // Pin voltage at a zero input, 0 for a single point
+        double sigma;  // The scatter of the points around the line, in pin microvolts
+        uint8_t count; // 0 if there is nothing to fit
+    };
+
+private:
+    Point points[MAX_POINTS]{};
+    uint8_t count = 0;
+
+public:
+    void clear()
+    {
+        count = 0;
+    }
+
+    inline uint8_t getCount() const
+    {
+        return count;
+    }
+
+    inline const Point &getPoint(const uint8_t index) const
+    {
+        return points[index];
+    }
+
+    /**
+     * @brief Add a point, replacing the one closer than ScaleCalibration::MIN_SPACING or the oldest one when full
+     *
+     * @return The index of the point
+     */
+    uint8_t addPoint(const Point &point)
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (std::fabs(points[i].raw - point.raw) < ScaleCalibration::MIN_SPACING)
+            {
+                points[i] = point;
+                return i;
+            }
+        }
+
+        if (count == MAX_POINTS)
+        {
+            for (uint8_t i = 0; i + 1 < count; i++)
+                points[i] = points[i + 1];
+            count--;
+        }
+        points[count] = point;
+        return count++;
+    }
+
+    Result fit() const
+    {
+        Result result{0, 0, 0, count};
+        if (!count)
+            return result;
+
+        // The noise of the points, all that is known about the scatter of fewer than 3 points
+        double noiseVariance = 0;
+        for (uint8_t i = 0; i < count; i++)
+            noiseVariance += points[i].noise * points[i].noise / count;
+
+        if (count == 1)
+        {
+            if (points[0].value == 0)
+                result.count = 0;
+            else
+                result.gain = points[0].raw / points[0].value;
+            result.sigma = std::sqrt(noiseVariance);
+            return result;
+        }
+
+        double meanValue = 0;
+        double meanRaw = 0;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            meanValue += points[i].value / count;
+            meanRaw += points[i].raw / count;
+        }
+        double sxx = 0;
+        double sxy = 0;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            sxx += (points[i].value - meanValue) * (points[i].value - meanValue);
+            sxy += (points[i].value - meanValue) * (points[i].raw - meanRaw);
+        }
+        if (sxx == 0)
+        {
+            result.count = 0;
+            return result;
+        }
+        result.gain = sxy / sxx;
+        result.offset = meanRaw - result.gain * meanValue;
+
+        double ssr = 0;
+        for (uint8_t i = 0; i < count; i++)
+            ssr += residual(i, result) * residual(i, result);
+        result.sigma = std::sqrt(count > 2 ? std::max(ssr / (count - 2), noiseVariance) : noiseVariance);
+        return result;
+    }
+
+    /**
+     * @brief Get the distance of a point from the line
+     *
+     * @return The measured minus the fitted pin voltage in microvolts
+     */
+    inline double residual(const uint8_t index, const Result &result) const
+    {
+        return points[index].raw - (result.gain * points[index].value + result.offset);
+    }
+
+    /**
+     * @brief Get the standard uncertainty of a reading, from the scatter of the points
+     *
+     * @param value The input at the ADC input side in micro-units
+     * @return The uncertainty in the same units
+     */
+    double uncertainty(const double value, const Result &result) const
+    {
+        if (!result.count || result.gain == 0)
+            return 0;
+        if (count == 1)
+            return result.sigma * std::fabs(value / points[0].value) / result.gain;
+
+        double meanValue = 0;
+        for (uint8_t i = 0; i < count; i++)
+            meanValue += points[i].value / count;
+        double sxx = 0;
+        for (uint8_t i = 0; i < count; i++)
+            sxx += (points[i].value - meanValue) * (points[i].value - meanValue);
+        return result.sigma * std::sqrt(1.0 / count + (value - meanValue) * (value - meanValue) / sxx) / result.gain;
+    }
+
+    /**
+     * @brief Replace a calibration with the fitted line, between the outer points
+     *
+     * @return false if there is nothing to fit
+     */
+    bool apply(const Result &result, ScaleCalibration &cal) const
+    {
+        if (!result.count || result.gain <= 0)
+            return false;
+
+        cal.clear();
+        if (count == 1)
+        {
+            cal.addPoint(std::lround(points[0].raw), std::lround(points[0].value));
+            return true;
+        }
+
+        double low = points[0].value;
+        double high = points[0].value;
+        for (uint8_t i = 1; i < count; i++)
+        {
+            low = std::min(low, points[i].value);
+            high = std::max(high, points[i].value);
+        }
+        low = std::max(low, -result.offset / result.gain); // The pin voltage can't be negative
+        cal.addPoint(std::lround(result.gain * low + result.offset), std::lround(low));
+        cal.addPoint(std::lround(result.gain * high + result.offset), std::lround(high));
+        return true;
+    }
+};
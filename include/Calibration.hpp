@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+
+#include "FixedPoint.hpp"
+
+/** A calibration point, the voltage at the ADC pin for a known input */
+struct CalPoint
+{
+    uint32_t raw;  // ADC pin voltage in microvolts
+    int32_t value; // Actual input at the amplifier in microvolts
+};
+
+/**
+ * @brief The calibration of one scale
+ *
+ * With a single point, the input is proportional to the raw voltage (gain only).
+ * With more points, the input is interpolated linearly between them, which also
+ * covers the offset near zero, and extrapolated with the outer segments.
+ * Everything is in fixed point, the slopes are precomputed when a point changes.
+ */
+class ScaleCalibration
+{
+public:
+    static constexpr uint8_t MAX_POINTS = 4;
+    static constexpr uint32_t MIN_SPACING = FixedPoint::ADC_FULL_SCALE_UV / 100; // Closer points are replaced
+
+private:
+    CalPoint points[MAX_POINTS]{};
+    int32_t slopes[MAX_POINTS - 1]{}; // Input per raw microvolt, Q16.16
+    uint8_t count = 0;
+
+    void update()
+    {
+        if (count == 1)
+        {
+            slopes[0] = points[0].raw ? (static_cast<int64_t>(points[0].value) << FixedPoint::FRAC_BITS) / points[0].raw : 0;
+            return;
+        }
+
+        for (uint8_t i = 0; i + 1 < count; i++)
+        {
+            int64_t dv = static_cast<int64_t>(points[i + 1].value) - points[i].value;
+            slopes[i] = (dv << FixedPoint::FRAC_BITS) / static_cast<int64_t>(points[i + 1].raw - points[i].raw);
+        }
+    }
+
+public:
+    /**
+     * @brief Remove all the points
+     */
+    void clear()
+    {
+        count = 0;
+    }
+
+    /**
+     * @brief Add a point, keeping them sorted by the raw voltage
+     *
+     * A point closer than MIN_SPACING to an existing one replaces it,
+     * and so does the nearest one when all points are used.
+     *
+     * @param raw The voltage at the ADC pin in microvolts
+     * @param value The actual input in microvolts
+     * @return The index of the point
+     */
+    uint8_t addPoint(const uint32_t raw, const int32_t value)
+    {
+        uint8_t nearest = 0;
+        uint32_t nearestDistance = UINT32_MAX;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            uint32_t distance = raw > points[i].raw ? raw - points[i].raw : points[i].raw - raw;
+            if (distance < nearestDistance)
+            {
+                nearest = i;
+                nearestDistance = distance;
+            }
+        }
+
+        if (count && (nearestDistance < MIN_SPACING || count == MAX_POINTS))
+        {
+            // Remove the replaced point
+            for (uint8_t i = nearest; i + 1 < count; i++)
+                points[i] = points[i + 1];
+            count--;
+        }
+
+        uint8_t pos = count;
+        while (pos > 0 && points[pos - 1].raw > raw)
+        {
+            points[pos] = points[pos - 1];
+            pos--;
+        }
+        points[pos] = {raw, value};
+        count++;
+        update();
+        return pos;
+    }
+
+    /**
+     * @brief Set a gain-only calibration
+     *
+     * @param gain The gain in Q16.16
+     */
+    void setGain(const uint32_t gain)
+    {
+        clear();
+        if (gain)
+            addPoint(FixedPoint::ADC_FULL_SCALE_UV, (static_cast<uint64_t>(FixedPoint::ADC_FULL_SCALE_UV) << FixedPoint::FRAC_BITS) / gain);
+    }
+
+    inline uint8_t getCount() const
+    {
+        return count;
+    }
+
+    inline const CalPoint &getPoint(const uint8_t index) const
+    {
+        return points[index];
+    }
+
+    /**
+     * @brief Get the overall gain, between the outer points
+     *
+     * @return The gain in Q16.16, or 0 if not calibrated
+     */
+    uint32_t gain() const
+    {
+        if (!count)
+            return 0;
+        if (count == 1)
+            return FixedPoint::gainFrom(points[0].raw, points[0].value);
+
+        auto &first = points[0];
+        auto &last = points[count - 1];
+        if (last.value <= first.value)
+            return 0;
+        return (static_cast<uint64_t>(last.raw - first.raw) << FixedPoint::FRAC_BITS) / (last.value - first.value);
+    }
+
+    /**
+     * @brief Convert a raw voltage to the input
+     *
+     * @param raw The voltage at the ADC pin in microvolts
+     * @return The input in microvolts
+     */
+    int32_t apply(const uint32_t raw) const
+    {
+        if (count == 0)
+            return FixedPoint::INVALID;
+        if (count == 1)
+            return (static_cast<int64_t>(raw) * slopes[0]) >> FixedPoint::FRAC_BITS;
+
+        uint8_t seg = 0;
+        while (seg + 2 < count && raw >= points[seg + 1].raw)
+            seg++;
+
+        int64_t delta = static_cast<int64_t>(raw) - points[seg].raw;
+        return points[seg].value + ((delta * slopes[seg]) >> FixedPoint::FRAC_BITS);
+    }
+};
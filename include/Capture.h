@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+#include "AdcCorrection.h"
+#include "Calibration.hpp"
+#include "config.h"
+
+/**
+ * Raw ADC capture, streamed over the serial port
+ *
+ * A capture is a Header followed by a BlockRecord for every sample block and an EndRecord.
+ * The header holds everything the measurement depends on (calibrations, ADC correction,
+ * auto-ranging and the starting scales), and the meters are restarted when the capture starts,
+ * so replaying the blocks through the same code gives the same readings bit for bit.
+ * All fields are little-endian and naturally aligned, so the host reads them as they are.
+ */
+namespace Capture
+{
+    constexpr char MAGIC[4] = {'U', 'I', 'M', 'C'};
+    constexpr uint8_t VERSION = 1;
+    constexpr auto CAL_POINTS = ScaleCalibration::MAX_POINTS;
+    constexpr uint32_t PACKED_BLOCK_SIZE = ADC_BLOCK_SIZE * 3 / 2; // 12-bit codes, 2 in 3 bytes
+    static_assert(ADC_BLOCK_SIZE % 2 == 0, "The codes are packed in pairs");
+
+    enum Marker : uint8_t
+    {
+        BLOCK = 'B',
+        END = 'E',
+    };
+
+    enum Flags : uint8_t
+    {
+        U_AUTO_RANGE = 1 << 0,
+        I_AUTO_RANGE = 1 << 1,
+    };
+
+    struct Header
+    {
+        char magic[4];
+        uint8_t version;
+        uint8_t channelCount;
+        uint16_t blockSize;
+        uint32_t sampleRate;
+        uint8_t uScale; // Active scales when the capture started
+        uint8_t iScale;
+        uint8_t flags;
+        uint8_t reserved;
+        int16_t spikeWidths[AdcCorrection::SPIKE_COUNT];
+        uint8_t uPointCounts[4];
+        uint8_t iPointCounts[4];
+        CalPoint uPoints[4][CAL_POINTS];
+        CalPoint iPoints[4][CAL_POINTS];
+    };
+    static_assert(sizeof(Header) == 32 + 2 * 4 * CAL_POINTS * sizeof(CalPoint), "Unexpected padding in the header");
+
+    struct BlockRecord
+    {
+        uint8_t marker; // Marker::BLOCK
+        uint8_t scales; // Scales the block was converted with, U in bits 0-1, I in bits 2-3
+        uint16_t reserved;
+        uint32_t sequence; // Counts the blocks since the start, a gap means dropped records
+        uint32_t timestamp; // In us since boot
+        int32_t uValue;     // Readings after the block, as VoltMeter::readVoltage()
+        int32_t iValue;
+        uint8_t codes[PACKED_BLOCK_SIZE];
+    };
+    static_assert(sizeof(BlockRecord) == 20 + PACKED_BLOCK_SIZE, "Unexpected padding in the block record");
+
+    struct EndRecord
+    {
+        uint8_t marker; // Marker::END
+        uint8_t reserved[3];
+        uint32_t blocks;  // Block records written
+        uint32_t dropped; // Block records dropped because the serial port was busy
+    };
+
+    /**
+     * @brief Pack 12-bit codes, 2 codes in 3 bytes
+     *
+     * @param codes The codes, an even count
+     * @param out The packed bytes, 3/2 of the code count
+     */
+    void pack(std::span<const uint16_t> codes, uint8_t *out);
+
+    /**
+     * @brief Unpack the codes packed by pack()
+     */
+    void unpack(const uint8_t *in, std::span<uint16_t> codes);
+
+    /**
+     * @brief Fill the calibration part of a header
+     */
+    void setCalibrations(Header &header, const ScaleCalibration (&uCals)[4], const ScaleCalibration (&iCals)[4]);
+
+    /**
+     * @brief Get the calibrations from a header
+     */
+    void getCalibrations(const Header &header, ScaleCalibration (&uCals)[4], ScaleCalibration (&iCals)[4]);
+
+    /**
+     * @brief Start streaming with the next block, the logs are muted until the capture ends
+     *
+     * @param header The header, the magic and the format fields are filled in
+     * @param maxBlocks The number of blocks to capture, 0 for no limit
+     */
+    void start(Header &header, const uint32_t maxBlocks);
+
+    /**
+     * @brief Stream a block if capturing, should be called after the block is converted
+     *
+     * The capture ends after maxBlocks, or when anything is received on the serial port.
+     *
+     * @param block The interleaved sample block
+     * @param uScale The voltage scale the block was converted with
+     * @param iScale The current scale the block was converted with
+     * @param uValue The voltage reading after the block
+     * @param iValue The current reading after the block
+     */
+    void writeBlock(std::span<const uint16_t> block, const uint8_t uScale, const uint8_t iScale,
+                    const int32_t uValue, const int32_t iValue);
+
+    bool isActive();
+
+} // namespace Capture
@@ -1,15 +1,101 @@
 #pragma once
-#include <functional>
+#include <cstdint>
+#include <cstdlib>
 #include <span>
-#include <Arduino.h>
+#include <string_view>
+
+#include "InplaceFunction.hpp"
 
 namespace Console
 {
 
-    /** Command callback type with various count of args, the first arg would be the command name */
-    using CmdCb = std::function<void(std::span<String>)>;
+    /** The type of a command argument, checked before the callback runs */
+    enum class ArgType : uint8_t
+    {
+        TEXT,
+        INT,
+        FLOAT,
+        CHOICE, // One of a list of words
+    };
+
+    /** The description of an argument, the constructors are constexpr so the tables can live in flash */
+    struct ArgSpec
+    {
+        ArgType type = ArgType::TEXT;
+        const char *name = "argument"; // For the messages
+        long min = 0;                  // The range of an INT
+        long max = 0;
+        float minFloat = 0; // The range of a FLOAT
+        float maxFloat = 0;
+        std::span<const char *const> choices{};
+
+        static constexpr ArgSpec text(const char *name)
+        {
+            return {ArgType::TEXT, name};
+        }
 
-    /** Command structure */
+        static constexpr ArgSpec integer(const char *name, const long min, const long max)
+        {
+            return {ArgType::INT, name, min, max};
+        }
+
+        static constexpr ArgSpec real(const char *name, const float min, const float max)
+        {
+            return {ArgType::FLOAT, name, 0, 0, min, max};
+        }
+
+        static constexpr ArgSpec choice(const char *name, std::span<const char *const> choices)
+        {
+            return {ArgType::CHOICE, name, 0, 0, 0, 0, choices};
+        }
+    };
+
+    /** A command argument, a token of the received line, valid during the callback */
+    class Arg
+    {
+    private:
+        std::string_view str; // Null-terminated in the line buffer
+        uint8_t choice = 0;   // The index of the word, for a CHOICE
+
+    public:
+        constexpr Arg() = default;
+        constexpr explicit Arg(const char *s, const std::size_t len) : str(s, len) {}
+
+        inline const char *c_str() const { return str.data(); }
+        inline std::string_view view() const { return str; }
+        inline std::size_t length() const { return str.size(); }
+        inline bool equals(const char *s) const { return str == s; }
+        inline long toInt() const { return std::strtol(str.data(), nullptr, 10); }
+        inline float toFloat() const { return std::strtof(str.data(), nullptr); }
+
+        /** The index of the word in the choices of a validated CHOICE argument */
+        inline uint8_t getChoice() const { return choice; }
+
+        /**
+         * @brief Check the argument against its description, and log why if it doesn't match
+         *
+         * @param spec The description, the index of a choice is kept
+         * @return true if valid
+         */
+        bool validate(const ArgSpec &spec);
+    };
+
+    /** The arguments of a command, the first one is the command name */
+    using Args = std::span<const Arg>;
+
+    /** Command callback type with various count of args */
+    using CmdCb = InplaceFunction<void(Args)>;
+
+    /** Handler of the lines that aren't commands, returns false if it doesn't take the line */
+    using LineHandler = InplaceFunction<bool(char *line, std::size_t len)>;
+
+    /**
+     * Command structure
+     *
+     * A command with subcommands takes the subcommand as its first argument, and runs its own
+     * callback, if any, only without arguments. The callback of a subcommand gets all the
+     * arguments of the line, the counts and the specs are of those after the subcommand name.
+     */
     struct Command
     {
         const char *name;
@@ -17,20 +103,61 @@ namespace Console
         uint8_t minArgCount;
         uint8_t maxArgCount;
         CmdCb cb;
+        std::span<const ArgSpec> argSpecs{};    // The types of the first arguments, the others are TEXT
+        std::span<const Command> subcommands{}; // Sorted by name
     };
 
+    /**
+     * @brief Check that a command table is sorted by name, so it can be searched by bisection
+     */
+    constexpr bool isSorted(std::span<const Command> table)
+    {
+        for (std::size_t i = 1; i < table.size(); i++)
+        {
+            if (std::string_view(table[i - 1].name) >= std::string_view(table[i].name))
+                return false;
+        }
+        return true;
+    }
+
     /**
      * @brief Initialize the serial port and the logging system
      */
     void init();
 
     /**
-     * @brief  Register a command
+     * @brief  Register a command, the commands are kept sorted by name
      *
-     * @param cmd  The command to register
+     * @param cmd  The command to register, its subcommand table is referenced and must outlive it
      */
     void registerCommand(const Command &cmd);
 
+    /**
+     * @brief Stop or resume printing the logs, e.g. while the serial port carries binary data
+     *
+     * @param muted Whether the logs are dropped
+     */
+    void setLogMuted(const bool muted);
+
+    /**
+     * @brief Set the handler of the lines whose first word isn't a command, e.g. another protocol
+     *
+     * A line taken by the handler switches the console to the remote mode, see setRemote().
+     *
+     * @param handler The handler, gets the null-terminated line without the leading spaces
+     */
+    void setLineHandler(LineHandler handler);
+
+    /**
+     * @brief Enter or leave the remote mode, for programs rather than a terminal
+     *
+     * In the remote mode, the input isn't echoed and neither the prompt nor the logs are written,
+     * so the serial port carries only the responses. Running a command leaves the remote mode.
+     *
+     * @param remote Whether to enter the remote mode
+     */
+    void setRemote(const bool remote);
+
     /**
      * @brief Handle the console event
      *
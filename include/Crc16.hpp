@@ -0,0 +1,33 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+
+namespace detail
+{
+    inline constexpr auto CRC16_TABLE = []
+    {
+        std::array<uint16_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint16_t crc = i << 8;
+            for (uint8_t b = 0; b < 8; b++)
+                crc = crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1;
+            table[i] = crc;
+        }
+        return table;
+    }();
+} // namespace detail
+
+/**
+ * @brief CRC-16/CCITT-FALSE, polynomial 0x1021, initial value 0xFFFF
+ *
+ * @param data The data
+ * @param crc The CRC of the data before, to continue it
+ */
+inline uint16_t crc16(std::span<const uint8_t> data, uint16_t crc = 0xFFFF)
+{
+    for (auto b : data)
+        crc = crc << 8 ^ detail::CRC16_TABLE[(crc >> 8 ^ b) & 0xFF];
+    return crc;
+}
@@ -1,10 +1,22 @@
 #pragma once
-#include <functional>
 #include <cstdint>
+#include <utility>
+
+#include "InplaceFunction.hpp"
 
 namespace Display
 {
-    using ReadKeyEventCallback = std::function<std::pair<uint32_t, bool>()>;
+    /** A key state for the LVGL keypad input */
+    struct KeyInput
+    {
+        uint32_t key; // An LV_KEY_* value
+        bool pressed;
+        bool more; // More inputs are queued, they're read in the same pass
+    };
+
+    /** Take the next queued key input, returns false if there is none */
+    using ReadKeyEventCallback = InplaceFunction<bool(KeyInput &)>;
+
     /**
      * @brief Initialize the display module
      *
@@ -14,10 +26,16 @@ namespace Display
     /**
      * @brief Main loop function for the display module
      *
+     * Handles the measurements, the keys and the LVGL timers, then sleeps until there is work again.
      * Should be called in a loop
      */
     void run();
 
+    /**
+     * @brief Wake up the UI to read the keys, from the key interrupt
+     */
+    void notifyKeyEvent();
+
     /**
      * @brief Set the Read Key Event Cb object
      *
@@ -25,19 +43,70 @@ namespace Display
      */
     void setReadKeyEventCb(ReadKeyEventCallback);
 
+    /** A reading of both channels, passed from core 0 to the UI on core 1 */
+    struct Measurement
+    {
+        uint32_t timestamp; // In us since boot
+        int32_t voltage;    // In microvolts, or a FixedPoint sentinel
+        int32_t current;    // In microamps, or a FixedPoint sentinel
+        uint8_t uScale;
+        uint8_t iScale;
+    };
+
+    /** How the UI takes the queued measurements */
+    enum class ConsumeMode : uint8_t
+    {
+        ALL,    // Every measurement in order
+        LATEST, // Only the newest one, the older ones only go to the history
+    };
+
+    /**
+     * @brief Queue a measurement for the display, from core 0
+     *
+     * Lock-free, the measurement is dropped and counted if the queue is full.
+     * Wakes up the UI core.
+     *
+     * @param m The measurement
+     */
+    void pushMeasurement(const Measurement &m);
+
+    /**
+     * @brief Set how the queued measurements are taken
+     *
+     * @param mode The consume mode
+     */
+    void setConsumeMode(const ConsumeMode mode);
+
     /**
-     * @brief Update the voltage value on the display
+     * @brief Get the number of measurements dropped because the queue was full
      *
-     * @param value The voltage value in volts, or INFINITY for overload, or -1 for invalid
+     * @return The overflow count
      */
-    void updateVoltage(const float);
+    uint32_t getQueueOverflows();
+
+    /**
+     * @brief Get the number of measurements skipped in the LATEST consume mode
+     *
+     * @return The skipped count
+     */
+    uint32_t getSkippedMeasurements();
+
+    /** Display refresh statistics over the last second */
+    struct FrameStats
+    {
+        uint32_t fps10;        // Refreshes per second, x10
+        uint32_t avgFlushUs;   // Transfer time of a rendered area
+        uint32_t maxFlushUs;
+        uint32_t waitPermille; // Share of the time LVGL waited for a transfer to free a buffer
+        uint32_t sleepPermille; // Share of the time the UI core slept
+    };
 
     /**
-     * @brief Update the current value on the display
+     * @brief Get the display refresh statistics, callable from the other core
      *
-     * @param value The current value in amperes, or INFINITY for overload, or -1 for invalid
+     * @return The statistics of the last second
      */
-    void updateCurrent(const float);
+    FrameStats getFrameStats();
 
     /** Predefined keys to control focused object via lv_group_send(group, c) */
     enum
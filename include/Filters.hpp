@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+/**
+ * Filter policies for VoltMeter
+ *
+ * Every policy takes raw ADC codes with push(), and provides:
+ *  - ready(): whether the output is settled
+ *  - mean(): the filtered value in ADC codes, Q16.16
+ *  - reset(): drop all the samples
+ *  - rescale(): multiply the held samples by a Q16.16 ratio, e.g. after a gain change
+ */
+
+/**
+ * @brief Moving average over the last N samples
+ *
+ * @tparam N Window length in samples
+ */
+template <uint16_t N>
+class BoxcarFilter
+{
+private:
+    static_assert(N > 0, "Invalid window length");
+    // 2^48 / N rounded up, the mean of a full window is then a multiplication
+    static constexpr uint64_t RECIPROCAL = ((1ull << 48) + N - 1) / N;
+
+    uint16_t buffer[N]{0};
+    uint16_t head = 0;   // Index of the oldest sample
+    uint16_t filled = 0;
+    uint32_t sum = 0;    // Running sum of the valid samples
+
+public:
+    inline void push(const uint16_t sample)
+    {
+        // The slots are zeroed on reset, so no need to tell an empty slot apart
+        sum += sample - buffer[head];
+        buffer[head] = sample;
+        head = (head + 1 == N) ? 0 : head + 1;
+        filled += (filled < N);
+    }
+
+    inline bool ready() const
+    {
+        return filled == N;
+    }
+
+    inline uint32_t mean() const
+    {
+        if (filled == N)
+            return (sum * RECIPROCAL) >> 32;
+        return filled ? (static_cast<uint64_t>(sum) << 16) / filled : 0;
+    }
+
+    void reset()
+    {
+        std::fill(std::begin(buffer), std::end(buffer), 0);
+        head = 0;
+        filled = 0;
+        sum = 0;
+    }
+
+    void rescale(const uint32_t ratio)
+    {
+        sum = 0;
+        for (auto &v : buffer)
+        {
+            v = std::min<uint64_t>((static_cast<uint64_t>(v) * ratio + (1 << 15)) >> 16, UINT16_MAX);
+            sum += v;
+        }
+    }
+};
+
+/**
+ * @brief Exponential moving average with a smoothing factor of 1/N
+ *
+ * The state is seeded with the first sample, and considered settled after N samples.
+ *
+ * @tparam N Time constant in samples, should be a power of 2
+ */
+template <uint16_t N>
+class EmaFilter
+{
+private:
+    static_assert(std::has_single_bit(N), "The time constant should be a power of 2");
+    static constexpr uint8_t SHIFT = std::countr_zero(N);
+    static constexpr uint8_t FRAC_BITS = 16;
+
+    int32_t state = 0; // Q16.16 ADC code
+    uint16_t count = 0;
+
+public:
+    inline void push(const uint16_t sample)
+    {
+        const int32_t input = static_cast<int32_t>(sample) << FRAC_BITS;
+        state = count ? state + ((input - state) >> SHIFT) : input;
+        count += (count < N);
+    }
+
+    inline bool ready() const
+    {
+        return count == N;
+    }
+
+    inline uint32_t mean() const
+    {
+        return state;
+    }
+
+    void reset()
+    {
+        state = 0;
+        count = 0;
+    }
+
+    void rescale(const uint32_t ratio)
+    {
+        // Clamped to the largest code the state holds, still far above the ADC range
+        state = std::min<int64_t>((static_cast<int64_t>(state) * ratio) >> 16, INT32_MAX);
+    }
+};
+
+/**
+ * @brief Median of the last N samples
+ *
+ * Pushing is O(1), the median is selected in O(N) when it's read,
+ * which suits short windows for rejecting spikes.
+ *
+ * @tparam N Window length in samples
+ */
+template <uint16_t N>
+class MedianFilter
+{
+private:
+    static_assert(N > 0, "Invalid window length");
+
+    uint16_t buffer[N]{0};
+    mutable uint16_t scratch[N];
+    uint16_t head = 0;
+    uint16_t filled = 0;
+
+public:
+    inline void push(const uint16_t sample)
+    {
+        buffer[head] = sample;
+        head = (head + 1 == N) ? 0 : head + 1;
+        filled += (filled < N);
+    }
+
+    inline bool ready() const
+    {
+        return filled == N;
+    }
+
+    uint32_t mean() const
+    {
+        if (!filled)
+            return 0;
+
+        // The valid samples are always at the beginning before the buffer wraps
+        std::copy(buffer, buffer + filled, scratch);
+        auto mid = scratch + filled / 2;
+        std::nth_element(scratch, mid, scratch + filled);
+        return static_cast<uint32_t>(*mid) << 16;
+    }
+
+    void reset()
+    {
+        head = 0;
+        filled = 0;
+    }
+
+    void rescale(const uint32_t ratio)
+    {
+        for (uint16_t i = 0; i < filled; i++)
+            buffer[i] = std::min<uint64_t>((static_cast<uint64_t>(buffer[i]) * ratio + (1 << 15)) >> 16, UINT16_MAX);
+    }
+};
+
+/**
+ * @brief Cascaded integrator-comb decimator
+ *
+ * Runs ORDER integrators at the sample rate and the combs at 1/N of it,
+ * the output is the latest decimated value normalized to ADC codes.
+ *
+ * @tparam N Decimation ratio, should be a power of 2
+ * @tparam ORDER Number of integrator/comb stages
+ */
+template <uint16_t N, uint8_t ORDER = 3>
+class CicFilter
+{
+private:
+    // The register width must hold the bit growth, wrapping of the integrators is cancelled by the combs
+    static_assert(std::has_single_bit(N), "The decimation ratio should be a power of 2");
+    static constexpr uint8_t GAIN_BITS = ORDER * std::countr_zero(N); // The DC gain is N^ORDER
+    static_assert(12 + GAIN_BITS <= 32, "CIC registers would overflow");
+
+    uint32_t integrators[ORDER]{0};
+    uint32_t combDelays[ORDER]{0};
+    uint32_t output = 0;
+    uint16_t phase = 0;
+    uint8_t outputs = 0; // Number of decimated outputs, saturates at ORDER
+
+    void decimate()
+    {
+        uint32_t val = integrators[ORDER - 1];
+        for (uint8_t i = 0; i < ORDER; i++)
+        {
+            auto delayed = combDelays[i];
+            combDelays[i] = val;
+            val -= delayed;
+        }
+        output = val;
+        outputs += (outputs < ORDER);
+    }
+
+public:
+    inline void push(const uint16_t sample)
+    {
+        uint32_t val = sample;
+        for (uint8_t i = 0; i < ORDER; i++)
+        {
+            integrators[i] += val;
+            val = integrators[i];
+        }
+
+        if (++phase == N)
+        {
+            phase = 0;
+            decimate();
+        }
+    }
+
+    /** The combs need ORDER outputs to flush the initial state */
+    inline bool ready() const
+    {
+        return outputs == ORDER;
+    }
+
+    inline uint32_t mean() const
+    {
+        if constexpr (GAIN_BITS >= 16)
+            return output >> (GAIN_BITS - 16);
+        else
+            return output << (16 - GAIN_BITS);
+    }
+
+    void reset()
+    {
+        std::fill(std::begin(integrators), std::end(integrators), 0);
+        std::fill(std::begin(combDelays), std::end(combDelays), 0);
+        output = 0;
+        phase = 0;
+        outputs = 0;
+    }
+
+    /** The wrapped integrator states can't be scaled, so start over */
+    void rescale(const uint32_t ratio)
+    {
+        reset();
+    }
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+/**
+ * Fixed-point helpers for the measurement pipeline
+ *
+ * The RP2040 has no FPU, so the values are kept as integers all the way:
+ *  - ADC codes are in Q16.16
+ *  - Gains are in Q16.16
+ *  - Voltages and currents are in microvolts and microamps (int32_t)
+ *
+ * Floats only appear at the edges (console input, display and logging).
+ */
+namespace FixedPoint
+{
+    constexpr uint8_t FRAC_BITS = 16;
+    constexpr uint32_t ONE = 1 << FRAC_BITS;
+
+    constexpr uint32_t ADC_FULL_SCALE_UV = 3300000; // ADC reference in microvolts
+    constexpr uint8_t ADC_BITS = 12;
+
+    /** Sentinels of the micro-unit values */
+    constexpr int32_t INVALID = std::numeric_limits<int32_t>::min();
+    constexpr int32_t OVERLOAD = std::numeric_limits<int32_t>::max();
+
+    /**
+     * @brief Convert a value in base units to micro-units
+     *
+     * @param value The value in volts or amperes
+     * @return The value in microvolts or microamps
+     */
+    constexpr int32_t toMicro(const float value)
+    {
+        return static_cast<int32_t>(value * 1e6f + (value < 0 ? -0.5f : 0.5f));
+    }
+
+    /**
+     * @brief Convert a table in base units to micro-units, at compile time
+     *
+     * @param values The values in volts or amperes
+     * @return The values in microvolts or microamps
+     */
+    template <std::size_t N>
+    constexpr std::array<int32_t, N> toMicro(const float (&values)[N])
+    {
+        std::array<int32_t, N> result{};
+        for (std::size_t i = 0; i < N; i++)
+            result[i] = toMicro(values[i]);
+        return result;
+    }
+
+    /**
+     * @brief Convert a micro-unit value for displaying
+     *
+     * @param value The value in micro-units, or a sentinel
+     * @return The value in base units, -1 for INVALID or INFINITY for OVERLOAD
+     */
+    inline float toFloat(const int32_t value)
+    {
+        if (value == INVALID)
+            return -1;
+        if (value == OVERLOAD)
+            return INFINITY;
+        return value * 1e-6f;
+    }
+
+    /**
+     * @brief Convert a gain to Q16.16
+     *
+     * @param gain The gain in float
+     * @return The gain in Q16.16
+     */
+    constexpr uint32_t toQ16(const float gain)
+    {
+        return static_cast<uint32_t>(gain * ONE + 0.5f);
+    }
+
+    /**
+     * @brief Convert an ADC code in Q16.16 to the voltage at the ADC pin
+     *
+     * @param code The ADC code in Q16.16
+     * @return The voltage in microvolts
+     */
+    constexpr uint32_t codeToMicrovolts(const uint32_t code)
+    {
+        return (static_cast<uint64_t>(code) * ADC_FULL_SCALE_UV) >> (FRAC_BITS + ADC_BITS);
+    }
+
+    /**
+     * @brief Calculate the gain from a measured voltage and the actual input
+     *
+     * @param pinMicrovolts The voltage at the ADC pin
+     * @param inputMicro The actual input in micro-units
+     * @return The gain in Q16.16, or 0 if the input is invalid
+     */
+    constexpr uint32_t gainFrom(const uint32_t pinMicrovolts, const int32_t inputMicro)
+    {
+        if (inputMicro <= 0)
+            return 0;
+        return ((static_cast<uint64_t>(pinMicrovolts) << FRAC_BITS) + inputMicro / 2) / inputMicro;
+    }
+
+} // namespace FixedPoint
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/**
+ * Thin hardware abstraction for the portable modules
+ *
+ * Implemented with the Arduino core in src/Hal.cpp, and with mocks in src/native/
+ * for the native environment, so the measurement, calibration and console code
+ * can be built and run on the host.
+ */
+namespace Hal
+{
+    // GPIO
+
+    void pinOutput(const uint32_t pin);
+
+    void pinInput(const uint32_t pin, const bool pullUp);
+
+    bool pinRead(const uint32_t pin);
+
+    /**
+     * @brief Set the output levels of several pins at once
+     *
+     * @param mask The pins to change
+     * @param value The levels of the pins in the mask
+     */
+    void pinsPut(const uint32_t mask, const uint32_t value);
+
+    // Time
+
+    uint32_t millis();
+
+    uint32_t micros();
+
+    using TimerCb = void (*)(void *);
+
+    /**
+     * @brief Call a function periodically from a timer interrupt, on core 0
+     *
+     * @param periodUs The period in microseconds
+     * @return false if no timer is left
+     */
+    bool startTimer(const uint32_t periodUs, TimerCb cb, void *param);
+
+    // Cores and interrupts
+
+    uint8_t coreNum();
+
+    /**
+     * @brief Disable the interrupts of the calling core
+     *
+     * @return The previous state, for interruptsRestore()
+     */
+    uint32_t interruptsOff();
+
+    void interruptsRestore(const uint32_t state);
+
+    // Serial console
+
+    void serialBegin(const uint32_t baudRate);
+
+    /**
+     * @brief Read a received character without blocking
+     *
+     * @return The character, or -1 if there is none
+     */
+    int serialRead();
+
+    /**
+     * @brief Get the room in the transmit buffer
+     *
+     * @return The number of bytes which can be written without blocking
+     */
+    std::size_t serialAvailableForWrite();
+
+    void serialWrite(const char *data, const std::size_t len);
+
+    void serialWrite(const char *str);
+
+    void serialPrintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+    // Non-volatile storage: whole flash sectors, read through the memory map and programmed a page at a time
+
+    constexpr std::size_t STORAGE_PAGE_SIZE = 256;
+    constexpr std::size_t STORAGE_SECTOR_SIZE = 4096;
+
+    /**
+     * @brief Get the storage area, erased bytes read 0xFF
+     */
+    std::span<const uint8_t> storageArea();
+
+    /**
+     * @brief Erase a sector of the storage area
+     *
+     * The other core is paused and the interrupts are off meanwhile, tens of ms.
+     *
+     * @param sector The sector index in the area
+     */
+    void storageErase(const std::size_t sector);
+
+    /**
+     * @brief Program an erased page of the storage area
+     *
+     * The other core is paused and the interrupts are off for this page only, under 1 ms.
+     *
+     * @param page The page index in the area
+     * @param data The page content, STORAGE_PAGE_SIZE bytes in RAM
+     */
+    void storageProgram(const std::size_t page, const uint8_t *data);
+
+    /**
+     * @brief Get the EEPROM emulation sector of the older firmware, for migrating the settings
+     */
+    std::span<const uint8_t> legacyStorageArea();
+
+} // namespace Hal
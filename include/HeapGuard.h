@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Detection of heap allocations after the setup
+ *
+ * The firmware allocates only while initializing, later allocations fragment the heap over
+ * a long uptime. Every C++ allocation is counted once both cores have finished their setup,
+ * and panics with HEAP_GUARD_PANIC. The C heap usage is also checked periodically, as malloc()
+ * itself is already wrapped by the core.
+ */
+namespace HeapGuard
+{
+    /**
+     * @brief Register the "heap" command
+     */
+    void init();
+
+    /**
+     * @brief Mark the setup of the calling core done, the guard is armed once both are
+     */
+    void setupDone();
+
+    /**
+     * @brief Compare the C heap usage with the one when the guard was armed, warn if it has grown
+     */
+    void check();
+
+} // namespace HeapGuard
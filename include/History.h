@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+/**
+ * Decimated history of both channels
+ *
+ * The readings are reduced to min/max/mean buckets of one second, the closed second buckets
+ * to minute buckets and those to hour buckets, each level in a ring of HISTORY_LENGTH.
+ * The raw readings are never kept, so reading a level costs the same however long it covers.
+ * Only used on the UI core.
+ */
+namespace History
+{
+    enum Level : uint8_t
+    {
+        SECONDS,
+        MINUTES,
+        HOURS,
+        LEVEL_COUNT,
+    };
+
+    enum Channel : uint8_t
+    {
+        VOLTAGE,
+        CURRENT,
+        CHANNEL_COUNT,
+    };
+
+    /** A bucket in micro-units, the mean is FixedPoint::INVALID if there was no valid reading */
+    struct Bucket
+    {
+        int32_t min;
+        int32_t max;
+        int32_t mean;
+    };
+
+    /**
+     * @brief Add a reading of both channels
+     *
+     * @param timestamp The time of the reading in us, only used for the second buckets
+     * @param voltage The voltage in microvolts, or a FixedPoint sentinel which is left out
+     * @param current The current in microamps, or a FixedPoint sentinel which is left out
+     */
+    void push(const uint32_t timestamp, const int32_t voltage, const int32_t current);
+
+    /**
+     * @brief Copy the buckets of a level, oldest first
+     *
+     * @param level The level
+     * @param channel The channel
+     * @param out The buckets, up to HISTORY_LENGTH
+     * @return The number of buckets copied
+     */
+    uint16_t read(const Level level, const Channel channel, std::span<Bucket> out);
+
+    /**
+     * @brief Get the revision of a level, which changes when a bucket of it is closed
+     */
+    uint32_t getRevision(const Level level);
+
+} // namespace History
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature, std::size_t Capacity = 4 * sizeof(void *)>
+class InplaceFunction;
+
+/**
+ * Callable wrapper like std::function, but the callable is stored in place and never on the heap
+ *
+ * Only trivially copyable callables are taken, i.e. function pointers and lambdas capturing
+ * pointers, references or plain values, so copying the wrapper is copying its bytes.
+ * A callable larger than the capacity doesn't compile, instead of silently allocating.
+ *
+ * @tparam R The return type
+ * @tparam Args The argument types
+ * @tparam Capacity The storage size in bytes
+ */
+template <typename R, typename... Args, std::size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+private:
+    alignas(void *) unsigned char storage[Capacity];
+    R (*invoker)(void *, Args...) = nullptr;
+
+public:
+    InplaceFunction() = default;
+
+    template <typename F>
+        requires(!std::is_same_v<std::decay_t<F>, InplaceFunction> && std::is_invocable_r_v<R, std::decay_t<F> &, Args...>)
+    InplaceFunction(F &&f)
+    {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= Capacity, "The callable is too large, capture less or by reference");
+        static_assert(alignof(Fn) <= alignof(void *), "The callable is over-aligned");
+        static_assert(std::is_trivially_copyable_v<Fn> && std::is_trivially_destructible_v<Fn>,
+                      "The callable must be trivially copyable, capture by reference");
+
+        ::new (static_cast<void *>(storage)) Fn(std::forward<F>(f));
+        invoker = [](void *s, Args... args) -> R
+        {
+            return (*static_cast<Fn *>(s))(std::forward<Args>(args)...);
+        };
+    }
+
+    inline explicit operator bool() const
+    {
+        return invoker;
+    }
+
+    inline R operator()(Args... args) const
+    {
+        return invoker(const_cast<unsigned char *>(storage), std::forward<Args>(args)...);
+    }
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Log-structured store of versioned records in the flash storage area, see Hal::storageArea()
+ *
+ * A commit appends a record after the previous one instead of rewriting it, so the sectors wear
+ * evenly and the latest complete record survives a power loss during a commit. The records are
+ * page aligned, CRC checked and don't cross sectors. The sectors are used as a ring, a sector is
+ * erased only when the ring wraps onto it, once every few commits. The pages of a record are
+ * programmed one at a time, the first one with the header last, so the other core is paused for
+ * a single page program at a time.
+ */
+namespace Journal
+{
+    /** The timing of a commit */
+    struct CommitStats
+    {
+        uint32_t totalUs;
+        uint32_t maxLockoutUs; // The longest pause of the other core
+        uint8_t pages;
+        bool erased; // A sector was erased first, the longest pause is the erase
+    };
+
+    using Hook = void (*)();
+
+    /**
+     * @brief Set the functions called around the sector erases
+     *
+     * An erase keeps the interrupts off for tens of ms, e.g. longer than the ADC DMA can run on its own.
+     *
+     * @param before Called before, may be nullptr
+     * @param after Called after, may be nullptr
+     */
+    void setEraseHooks(Hook before, Hook after);
+
+    /**
+     * @brief Find the latest record, should be called before the others
+     *
+     * @return false if the storage area is too small for the journal
+     */
+    bool init();
+
+    /**
+     * @brief Read the latest record
+     *
+     * @param version The version of the payload layout
+     * @param data The payload, cut to maxLen
+     * @param maxLen The room in data
+     * @return The payload length, 0 if there is no record
+     */
+    std::size_t readLatest(uint16_t &version, void *data, const std::size_t maxLen);
+
+    /**
+     * @brief Append a record, which becomes the latest one
+     *
+     * @param version The version of the payload layout
+     * @param data The payload
+     * @param len The payload length, up to a sector with the header
+     * @param stats The timing of the commit
+     * @return false if the record couldn't be written
+     */
+    bool append(const uint16_t version, const void *data, const std::size_t len, CommitStats &stats);
+
+} // namespace Journal
@@ -1,34 +1,104 @@
 #pragma once
 
-#include <vector>
+#include <cstdint>
 #include <span>
-#include <utility>
 
+#include "Hal.h"
+#include "Log.h"
+#include "SpscRing.hpp"
+#include "config.h"
+
+/**
+ * Keys scanned by a timer interrupt, debounced, and queued as timestamped events
+ *
+ * A key is taken as pressed or released once its level held for KEY_DEBOUNCE_SCANS scans,
+ * so the bounces are ignored. While it's held, a long press event follows after
+ * KEY_LONG_PRESS_TIME, then a repeat event every KEY_REPEAT_PERIOD. The events are queued
+ * from the interrupt, so a short press between two reads of the consumer isn't lost.
+ */
 class KeyPad
 {
+public:
+    static constexpr uint8_t MAX_KEYS = 8;
+
+    enum class EventType : uint8_t
+    {
+        PRESS,
+        RELEASE,
+        LONG_PRESS,
+        REPEAT,
+    };
+
+    struct Event
+    {
+        uint32_t timestamp; // In ms since boot
+        uint8_t key;        // The pin number
+        EventType type;
+    };
+
 private:
-    std::vector<int> keys;
+    struct KeyState
+    {
+        uint8_t pin;
+        uint8_t count;    // Scans the level differed from the debounced state
+        bool pressed;     // Debounced
+        uint32_t holdDue; // The time of the next long press or repeat event
+        bool longPressed;
+    };
+
     bool activeState;
 
-    int lastKeyPin;
-    bool lastKeyState;
+    using ChangeCb = void (*)();
+    ChangeCb onChange = nullptr;
+
+    KeyState keys[MAX_KEYS]{};
+    uint8_t keyCount = 0;
+    bool scanning = false;
 
-    struct KeyEvent
+    // The scan interrupt is the producer, the UI the consumer
+    SpscRing<Event, KEY_QUEUE_LENGTH> events;
+
+    void push(const uint8_t pin, const EventType type, const uint32_t now)
     {
-        KeyPad *keypad;
-        int key;
-    };
+        events.push({now, pin, type});
+    }
 
     /**
-     * @brief The callback function for the key state change interrupt.
-     *
-     * @param params The parameters passed to the interrupt.
+     * @brief Scan the keys, from the timer interrupt
      */
-    static void onKeyStateChange(void *params)
+    static void onScan(void *param)
     {
-        auto event = static_cast<KeyEvent *>(params);
-        event->keypad->lastKeyPin = event->key;
-        event->keypad->lastKeyState = (digitalRead(event->key) == event->keypad->activeState);
+        auto keypad = static_cast<KeyPad *>(param);
+        auto now = Hal::millis();
+        bool changed = false;
+        for (uint8_t i = 0; i < keypad->keyCount; i++)
+        {
+            auto &key = keypad->keys[i];
+            bool pressed = Hal::pinRead(key.pin) == keypad->activeState;
+            if (pressed == key.pressed)
+                key.count = 0;
+            else if (++key.count >= KEY_DEBOUNCE_SCANS)
+            {
+                key.count = 0;
+                key.pressed = pressed;
+                key.longPressed = false;
+                key.holdDue = now + KEY_LONG_PRESS_TIME;
+                keypad->push(key.pin, pressed ? EventType::PRESS : EventType::RELEASE, now);
+                changed = true;
+                continue;
+            }
+
+            if (key.pressed && static_cast<int32_t>(now - key.holdDue) >= 0)
+            {
+                keypad->push(key.pin, key.longPressed ? EventType::REPEAT : EventType::LONG_PRESS, now);
+                key.longPressed = true;
+                key.holdDue += KEY_REPEAT_PERIOD;
+                changed = true;
+            }
+        }
+
+        if (changed && keypad->onChange)
+            keypad->onChange();
     }
 
 public:
@@ -44,26 +114,74 @@ public:
     {
     }
 
+    KeyPad(const KeyPad &) = delete;
+    KeyPad &operator=(const KeyPad &) = delete;
+
     /**
-     * @brief Add a key to the keypad.
+     * @brief Add a key to the keypad, before begin()
      *
      * @param key The pin number of the key.
      */
     void addKey(int key)
     {
-        keys.push_back(key);
-        pinMode(key, INPUT_PULLUP);
-        auto params = new KeyEvent{this, key};
-        attachInterruptParam(key, onKeyStateChange, CHANGE, static_cast<void *>(params));
+        if (keyCount >= MAX_KEYS || scanning)
+        {
+            ULOG_ERROR("Unable to add key: %d, %s", key, scanning ? "already scanning" : "too many keys");
+            return;
+        }
+
+        keys[keyCount++] = {static_cast<uint8_t>(key), 0, false, 0, false};
+        Hal::pinInput(key, true);
     }
 
     /**
-     * @brief Get the Last Key Event
+     * @brief Set the function called from the interrupt when events were queued
      *
-     * @return std::pair<int, bool> The pin number and the state of the last key event.
+     * @param cb The function, e.g. waking up the consumer of the key events
+     */
+    void setOnChange(void (*cb)())
+    {
+        onChange = cb;
+    }
+
+    /**
+     * @brief Start scanning the keys
+     *
+     * The timer interrupt refers to the keypad, so it must stay in place from then on.
+     */
+    void begin()
+    {
+        if (!Hal::startTimer(KEY_SCAN_PERIOD * 1000, onScan, this))
+        {
+            ULOG_ERROR("Unable to scan the keys: no timer left");
+            return;
+        }
+        scanning = true;
+    }
+
+    /**
+     * @brief Take the oldest key event, consumer side
+     *
+     * @return false if there is none
+     */
+    bool popEvent(Event &event)
+    {
+        return events.pop(event);
+    }
+
+    /**
+     * @brief Whether more key events are queued, consumer side
+     */
+    bool hasEvents() const
+    {
+        return events.size();
+    }
+
+    /**
+     * @brief Get the number of events dropped because the queue was full
      */
-    std::pair<int, bool> getLastKeyEvent()
+    uint32_t getOverflows() const
     {
-        return {lastKeyPin, lastKeyState};
+        return events.getOverflows();
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,175 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <ulog.h>
+
+#include "config.h"
+
+/**
+ * Asynchronous logging behind the ULOG_* macros
+ *
+ * A log call only captures the level, the time, the format and the arguments into a ring of
+ * the calling core; strings are copied, so they may be temporary. The records are formatted
+ * and written to the serial port later by drain(), when the port has room, so logging never
+ * waits for the host. A full ring drops the record and counts it.
+ * Safe from both cores and from interrupts. The format must have static storage, e.g. a literal.
+ */
+namespace Log
+{
+    using Formatter = int (*)(char *out, std::size_t len, const char *fmt, const uint8_t *args);
+
+    struct Record
+    {
+        uint32_t timestamp; // In ms since boot
+        const char *fmt;
+        Formatter formatter;
+        uint8_t level;
+        bool truncated; // Strings were cut to fit in args
+        uint8_t args[LOG_ARG_BYTES];
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        constexpr bool IS_STRING = std::is_same_v<std::decay_t<T>, const char *> || std::is_same_v<std::decay_t<T>, char *>;
+
+        /** The type an argument is stored as, i.e. as it would be passed through the variadic arguments */
+        template <typename T>
+        using Stored = std::conditional_t<IS_STRING<T>, const char *,
+                                          std::conditional_t<std::is_floating_point_v<std::decay_t<T>>, double,
+                                                             decltype(+std::declval<std::decay_t<T>>())>>;
+
+        template <typename T>
+        inline void pack(uint8_t *buf, std::size_t &pos, std::size_t &stringRoom, bool &complete, const T &arg)
+        {
+            if constexpr (IS_STRING<T>)
+            {
+                const char *s = arg; // Arrays decay here
+                if (!s)
+                    s = "(null)";
+                std::size_t n = 0;
+                while (n < stringRoom && s[n])
+                    n++;
+                complete &= !s[n];
+                memcpy(buf + pos, s, n);
+                buf[pos + n] = '\0';
+                pos += n + 1;
+                stringRoom -= n;
+            }
+            else
+            {
+                Stored<T> v = arg;
+                memcpy(buf + pos, &v, sizeof(v));
+                pos += sizeof(v);
+            }
+        }
+
+        template <typename S>
+        inline S unpack(const uint8_t *&p)
+        {
+            if constexpr (std::is_same_v<S, const char *>)
+            {
+                auto s = reinterpret_cast<const char *>(p);
+                p += strlen(s) + 1;
+                return s;
+            }
+            else
+            {
+                S v;
+                memcpy(&v, p, sizeof(v));
+                p += sizeof(v);
+                return v;
+            }
+        }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+        template <typename... S>
+        int format(char *out, std::size_t len, const char *fmt, [[maybe_unused]] const uint8_t *args)
+        {
+            // Braced initialization, so the arguments are unpacked in order
+            std::tuple<S...> values{unpack<S>(args)...};
+            return std::apply([&](auto... v)
+                              { return snprintf(out, len, fmt, v...); }, values);
+        }
+#pragma GCC diagnostic pop
+    } // namespace detail
+
+    /**
+     * @brief Queue a record in the ring of the calling core, or count it as dropped
+     *
+     * @param record The record, the timestamp is set here
+     */
+    void enqueue(Record &record);
+
+    /**
+     * @brief Log a message, use the ULOG_* macros
+     *
+     * @param level The level, the messages below LOG_LEVEL are ignored
+     * @param fmt The printf format, with static storage
+     * @param args The arguments
+     */
+    template <typename... A>
+    inline void write(const ulog_level_t level, const char *fmt, const A &...args)
+    {
+        if (level < LOG_LEVEL)
+            return;
+
+        // A byte of each string is taken by its terminator, the rest of the room is shared by their characters
+        constexpr std::size_t fixed = (0 + ... + (detail::IS_STRING<A> ? 1 : sizeof(detail::Stored<A>)));
+        static_assert(fixed <= LOG_ARG_BYTES, "Too many log arguments, see LOG_ARG_BYTES");
+
+        Record record;
+        record.fmt = fmt;
+        record.formatter = detail::format<detail::Stored<A>...>;
+        record.level = level;
+        [[maybe_unused]] std::size_t pos = 0;
+        [[maybe_unused]] std::size_t stringRoom = LOG_ARG_BYTES - fixed;
+        bool complete = true;
+        (detail::pack(record.args, pos, stringRoom, complete, args), ...);
+        record.truncated = !complete;
+        enqueue(record);
+    }
+
+    /**
+     * @brief Format and write the queued records while the serial port has room, without blocking
+     *
+     * Should be called periodically from core 0.
+     */
+    void drain();
+
+    /**
+     * @brief Write all the queued records, waiting for the serial port
+     *
+     * For the console output, so the logs of a command come before what follows.
+     */
+    void flush();
+
+    /**
+     * @brief Drop the records instead of writing them, e.g. while the serial port carries binary data
+     */
+    void setMuted(const bool muted);
+
+} // namespace Log
+
+#ifdef ULOG_ENABLED
+#undef ULOG_TRACE
+#undef ULOG_DEBUG
+#undef ULOG_INFO
+#undef ULOG_WARNING
+#undef ULOG_ERROR
+#undef ULOG_CRITICAL
+#undef ULOG_ALWAYS
+#define ULOG_TRACE(...) Log::write(ULOG_TRACE_LEVEL, __VA_ARGS__)
+#define ULOG_DEBUG(...) Log::write(ULOG_DEBUG_LEVEL, __VA_ARGS__)
+#define ULOG_INFO(...) Log::write(ULOG_INFO_LEVEL, __VA_ARGS__)
+#define ULOG_WARNING(...) Log::write(ULOG_WARNING_LEVEL, __VA_ARGS__)
+#define ULOG_ERROR(...) Log::write(ULOG_ERROR_LEVEL, __VA_ARGS__)
+#define ULOG_CRITICAL(...) Log::write(ULOG_CRITICAL_LEVEL, __VA_ARGS__)
+#define ULOG_ALWAYS(...) Log::write(ULOG_ALWAYS_LEVEL, __VA_ARGS__)
+#endif
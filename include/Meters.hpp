@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Filters.hpp"
+#include "VoltMeter.hpp"
+#include "config.h"
+
+/** The meters of both channels, shared by the firmware and the host replay so they filter the same way */
+using UMeter = VoltMeter<BoxcarFilter, U_FILTER_SAMPLES>;
+using IMeter = VoltMeter<EmaFilter, I_FILTER_SAMPLES>;
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * Execution time probes
+ *
+ * Only built with PERF_ENABLED, see the pico_perf environment, otherwise the probes are empty.
+ * Each core keeps its own statistics, so recording needs no locking.
+ */
+namespace Perf
+{
+    enum Probe : uint8_t
+    {
+        SAMPLE,       // Filtering of the ADC blocks
+        RANGE,        // Auto-ranging of a block
+        VALUE,        // Reading and queuing a measurement
+        LOG,          // Debug logging of a measurement
+        CONSOLE,      // Console handling
+        LVGL_TIMER,   // lv_timer_handler() as a whole
+        LVGL_RENDER,  // Rendering of a display refresh, without waiting for the transfers
+        LVGL_FLUSH,   // DMA transfer of a rendered area to the screen
+        PROBE_COUNT,
+    };
+
+    constexpr uint8_t HIST_BUCKETS = 16; // Log2 buckets of microseconds, the last one takes the rest
+
+    /**
+     * @brief Register the "perf" command
+     */
+    void init();
+
+#ifdef PERF_ENABLED
+    /**
+     * @brief Get the timestamp of the 1us hardware timer
+     */
+    uint32_t now();
+
+    /**
+     * @brief Record a duration for the calling core
+     *
+     * @param probe The probe
+     * @param start The timestamp from now() at the beginning
+     */
+    void record(const Probe probe, const uint32_t start);
+
+    /** Records the lifetime of the scope */
+    class Scope
+    {
+    private:
+        Probe probe;
+        uint32_t start;
+
+    public:
+        inline explicit Scope(const Probe probe) : probe(probe), start(now()) {}
+        inline ~Scope() { record(probe, start); }
+    };
+#endif
+
+} // namespace Perf
+
+#ifdef PERF_ENABLED
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#define PERF_SCOPE(probe) Perf::Scope PERF_CONCAT(perfScope, __LINE__)(Perf::probe)
+#else
+#define PERF_SCOPE(probe) \
+    do                    \
+    {                     \
+    } while (0)
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <lvgl.h>
+
+/**
+ * Fixed-width numeric readout
+ *
+ * The text is laid out in cells as wide as the widest digit of the font, right-aligned.
+ * Each cell is drawn from the glyph bitmaps of the font on its own, so a new value only
+ * invalidates the cells whose character changed instead of the whole label, and an
+ * unchanged value invalidates nothing.
+ */
+class Readout
+{
+public:
+    static constexpr uint8_t MAX_CELLS = 12;
+
+    /**
+     * @brief Create the widget
+     *
+     * @param parent The parent object
+     * @param font The font, should have all digits
+     * @param cellCount The number of character cells, up to MAX_CELLS
+     */
+    void create(lv_obj_t *parent, const lv_font_t *font, const uint8_t cellCount);
+
+    /**
+     * @brief Get the LVGL object, for aligning the widget
+     */
+    lv_obj_t *getObj() const
+    {
+        return obj;
+    }
+
+    /**
+     * @brief Set the text, right-aligned and cut to the cell count from the left
+     *
+     * @param text The text
+     */
+    void setText(const char *text);
+
+    /**
+     * @brief Show a value with 2 decimals
+     *
+     * @param value The value in micro-units, or a FixedPoint sentinel
+     * @param unit The unit character
+     */
+    void setValue(const int32_t value, const char unit);
+
+private:
+    lv_obj_t *obj = nullptr;
+    const lv_font_t *font = nullptr;
+    uint8_t cellCount = 0;
+    int32_t cellWidth = 0;
+    char cells[MAX_CELLS]{};
+
+    /**
+     * @brief Get the area of a cell, widened on both sides if the glyph is wider than a digit
+     *
+     * @param index The cell index
+     * @param c The character in the cell
+     * @param area The area in screen coordinates
+     */
+    void getCellArea(const uint8_t index, const char c, lv_area_t &area) const;
+
+    static void onDraw(lv_event_t *ev);
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "AdcSampler.h"
+#include "Crc16.hpp"
+#include "config.h"
+
+/**
+ * Framed binary sample stream over the serial port
+ *
+ * Every frame is a payload followed by its CRC-16/CCITT-FALSE (little-endian), COBS encoded
+ * and terminated by a zero byte, so the host can resynchronize at any zero after a loss.
+ * A payload starts with a FrameHeader; the stream opens with a START frame, carries a RAW or
+ * FILTERED frame per processed ADC block, and closes with an END frame.
+ * All fields are little-endian and naturally aligned.
+ */
+namespace SampleStream
+{
+    constexpr uint8_t VERSION = 1;
+    constexpr uint32_t CHANNEL_RATE = ADC_SAMPLE_RATE / AdcSampler::CHANNEL_COUNT; // Samples per second of each channel
+    constexpr uint32_t BLOCK_PAIRS = ADC_BLOCK_SIZE / AdcSampler::CHANNEL_COUNT;   // U/I pairs in a block
+    constexpr uint32_t BLOCK_PERIOD_NS = 1000000000ull * ADC_BLOCK_SIZE / ADC_SAMPLE_RATE;
+
+    enum class Mode : uint8_t
+    {
+        RAW,      // ADC codes of both channels, decimated
+        FILTERED, // Readings in micro-units after a block, every few blocks
+    };
+
+    enum FrameType : uint8_t
+    {
+        START = 'S',
+        RAW = 'R',
+        FILTERED = 'F',
+        END = 'E',
+    };
+
+    struct FrameHeader
+    {
+        uint8_t type;
+        uint8_t scales;     // Scales of the samples, U in bits 0-1, I in bits 2-3
+        uint16_t count;     // U/I pairs in the frame
+        uint32_t sequence;  // Counts the data frames, dropped ones included, so a gap means a loss
+        uint32_t timestamp; // When the block was processed, in us since boot, the pairs are evenly spaced
+        uint32_t dropped;   // Data frames dropped so far because the serial port was busy
+    };
+    static_assert(sizeof(FrameHeader) == 16, "Unexpected padding in the frame header");
+
+    /** After the header of the START frame, whose timestamp is when the stream was started, with no scales */
+    struct StartInfo
+    {
+        uint8_t version;
+        uint8_t mode; // Mode
+        uint16_t reserved;
+        uint32_t periodNs; // Between the pairs
+    };
+
+    /** After the header of the END frame */
+    struct EndInfo
+    {
+        uint32_t frames;      // Data frames written
+        uint32_t adcDropped;  // ADC blocks overwritten before being processed, during the stream
+    };
+
+    /** In a FILTERED frame, after the header */
+    struct Reading
+    {
+        int32_t voltage; // Microvolts, or a FixedPoint sentinel
+        int32_t current; // Microamps, or a FixedPoint sentinel
+    };
+
+    constexpr std::size_t MAX_PAYLOAD = sizeof(FrameHeader) + BLOCK_PAIRS * 3; // A full-rate raw block
+    constexpr std::size_t MAX_FRAME = MAX_PAYLOAD + 2 + (MAX_PAYLOAD + 2) / 254 + 2;
+
+    using ::crc16; // The frame CRC, see Crc16.hpp
+
+    /**
+     * @brief COBS encode, without the terminating zero
+     *
+     * @param in The data
+     * @param out The encoded data, at least in.size() + in.size() / 254 + 1 bytes
+     * @return The encoded length
+     */
+    std::size_t cobsEncode(std::span<const uint8_t> in, uint8_t *out);
+
+    /**
+     * @brief COBS decode, in place is allowed
+     *
+     * @param in The encoded data, without the terminating zero
+     * @param out The decoded data, at least in.size() bytes
+     * @return The decoded length, 0 if the data is malformed
+     */
+    std::size_t cobsDecode(std::span<const uint8_t> in, uint8_t *out);
+
+    /**
+     * @brief Start streaming with the next block, the logs are muted until the stream ends
+     *
+     * @param mode What is streamed
+     * @param divider RAW: keep every n-th pair, FILTERED: a reading every n blocks
+     */
+    void start(const Mode mode, const uint32_t divider);
+
+    /**
+     * @brief Stream a block if streaming, should be called after the block is converted
+     *
+     * The stream ends when anything is received on the serial port.
+     *
+     * @param block The interleaved sample block
+     * @param uScale The voltage scale the block was converted with
+     * @param iScale The current scale the block was converted with
+     * @param reading The readings after the block
+     */
+    void writeBlock(std::span<const uint16_t> block, const uint8_t uScale, const uint8_t iScale,
+                    const Reading &reading);
+
+    bool isActive();
+
+} // namespace SampleStream
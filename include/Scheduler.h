@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+
+#include "InplaceFunction.hpp"
+
+namespace Scheduler
+{
+    /** What to do with the releases missed while a task was late */
+    enum class Policy : uint8_t
+    {
+        SKIP,     // Drop them and stay on the period grid
+        CATCH_UP, // Run them back to back, up to MAX_CATCH_UP periods behind
+    };
+
+    using TaskCb = InplaceFunction<void()>;
+
+    constexpr uint8_t MAX_TASKS = 8;
+    constexpr uint8_t MAX_CATCH_UP = 4;
+
+    /**
+     * @brief Claim the hardware alarm and register the "tasks" command
+     */
+    void init();
+
+    /**
+     * @brief Add a periodic task, the tasks added earlier run first when released together
+     *
+     * @param name The task name for the statistics
+     * @param periodUs The period in microseconds
+     * @param cb The task function
+     * @param policy What to do when releases are missed
+     * @param deadlineUs The allowed start delay after the release, 0 for the whole period
+     * @return false if there are too many tasks
+     */
+    bool addTask(const char *name, const uint32_t periodUs, TaskCb cb, const Policy policy = Policy::SKIP,
+                 const uint32_t deadlineUs = 0);
+
+    /**
+     * @brief Run the tasks forever
+     *
+     * The core sleeps with WFE until the alarm of the next release, or any other interrupt.
+     */
+    [[noreturn]] void run();
+
+} // namespace Scheduler
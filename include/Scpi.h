@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "InplaceFunction.hpp"
+
+/**
+ * SCPI command layer for the test stations
+ *
+ * The console lines that aren't console commands and look like SCPI, i.e. their first header
+ * starts with '*' or holds ':' or '?', are handled here, and switch the console to the remote
+ * mode. Commands are chained with ';', a header without a leading ':' is relative to the node
+ * of the previous one, e.g. "MEAS:VOLT?;CURR?". The responses of the queries of a line are
+ * joined with ';' on a single line. The errors go to the error queue, read with SYST:ERR?.
+ *
+ * The measurements are answered from the latest readings, in V and A, 9.9E37 for an overload
+ * and 9.91E37 if there is no valid reading. The queries never wait for a measurement.
+ *
+ *   *IDN?, *RST, *CLS, *OPC?
+ *   MEASure:VOLTage[:DC]?, MEASure:CURRent[:DC]?
+ *   CONFigure:RANGe:VOLTage <0-3|AUTO>, CONFigure:RANGe:VOLTage?            Fixed scale, or automatic
+ *   CONFigure:RANGe:VOLTage:AUTO <ON|OFF>, CONFigure:RANGe:VOLTage:AUTO?
+ *   CONFigure:RANGe:CURRent..., as the voltage
+ *   [SENSe]:AVERage:COUNt <1-SCPI_MAX_AVERAGE>, [SENSe]:AVERage:COUNt?      Readings averaged by the queries
+ *   SYSTem:ERRor[:NEXT]?, SYSTem:LOCal                                       Leave the remote mode
+ */
+namespace Scpi
+{
+    enum class Channel : uint8_t
+    {
+        VOLTAGE,
+        CURRENT,
+    };
+
+    static constexpr int8_t AUTO_RANGE = -1;
+
+    struct Range
+    {
+        uint8_t scale; // The active scale
+        bool autoRange;
+    };
+
+    using GetRangeCb = InplaceFunction<Range(Channel)>;
+
+    /** Select a scale, or AUTO_RANGE, returns false if not possible now, e.g. while calibrating */
+    using SetRangeCb = InplaceFunction<bool(Channel, int8_t)>;
+
+    /**
+     * @brief Take the SCPI lines of the console
+     *
+     * @param getRange Gets the range of a channel
+     * @param setRange Sets the range of a channel
+     */
+    void init(GetRangeCb getRange, SetRangeCb setRange);
+
+    /**
+     * @brief Keep a reading for the queries, from the same core as the console
+     *
+     * @param voltage The voltage in uV, or a FixedPoint sentinel
+     * @param current The current in uA, or a FixedPoint sentinel
+     */
+    void pushReading(const int32_t voltage, const int32_t current);
+
+    /**
+     * @brief Run the commands of a line and write the responses
+     *
+     * @param line The null-terminated line, modified
+     * @param len The line length
+     * @return false if the line doesn't look like SCPI
+     */
+    bool handleLine(char *line, const std::size_t len);
+
+} // namespace Scpi
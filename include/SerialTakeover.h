@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * The serial port taken from the console for a binary stream, see Capture and SampleStream
+ *
+ * The logs are muted meanwhile, so the port carries only the records. The opening record is held
+ * until the first block, so it comes after the console prompt, and anything received asks to stop.
+ */
+namespace SerialTakeover
+{
+    /**
+     * @brief Take the serial port, the input typed so far is dropped
+     *
+     * @param opening The opening record, must stay in place until the first block
+     * @param len The length of the opening record
+     */
+    void take(const void *opening, const std::size_t len);
+
+    /**
+     * @brief Start the records of a block, the opening record is written with the first one
+     *
+     * @return false if anything was received, the stream should then be closed
+     */
+    bool nextBlock();
+
+    /**
+     * @brief Check whether a record can be written without stalling the sampling
+     *
+     * A record can be larger than the USB transmit buffer, so it's only written once the previous one has drained.
+     *
+     * @param len The length of the record
+     */
+    bool canWrite(const std::size_t len);
+
+    /**
+     * @brief Write a record, the closing one regardless of canWrite()
+     */
+    void write(const void *data, const std::size_t len);
+
+    /**
+     * @brief Give the serial port back to the console
+     */
+    void release();
+
+    bool isActive();
+
+} // namespace SerialTakeover
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "AdcCorrection.h"
+#include "Calibration.hpp"
+
+/**
+ * Persistent settings: the calibrations of every scale and the ADC correction
+ *
+ * They're committed to the flash journal, see Journal.h, the EEPROM sector of the earlier versions is only read.
+ */
+namespace Settings
+{
+    constexpr auto CAL_POINTS = ScaleCalibration::MAX_POINTS;
+
+    /**
+     * @brief Load the calibrations and the ADC correction
+     *
+     * The settings of the earlier versions are read from the EEPROM sector and committed in the current layout,
+     * version 1 ones are converted to single-point calibrations, the defaults are used for whatever is missing.
+     *
+     * @param uCals The calibrations of the voltage scales
+     * @param iCals The calibrations of the current scales
+     * @param spikeWidths The widths of the ADC wide codes
+     */
+    void load(ScaleCalibration (&uCals)[4], ScaleCalibration (&iCals)[4],
+              int16_t (&spikeWidths)[AdcCorrection::SPIKE_COUNT]);
+
+    /**
+     * @brief Commit the calibrations and the ADC correction, and log the commit latency
+     *
+     * @return false if they couldn't be written
+     */
+    bool save(const ScaleCalibration (&uCals)[4], const ScaleCalibration (&iCals)[4],
+              const int16_t (&spikeWidths)[AdcCorrection::SPIKE_COUNT]);
+
+} // namespace Settings
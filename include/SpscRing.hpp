@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+/**
+ * @brief Lock-free ring buffer for one producer and one consumer, e.g. on the two cores
+ *
+ * Each index is written by one side only, so plain atomic loads and stores are enough,
+ * which the Cortex-M0+ has (it has no read-modify-write atomics).
+ * A full ring rejects the new element and counts it as an overflow.
+ *
+ * @tparam T Element type, should be trivially copyable
+ * @tparam N Capacity, should be a power of 2
+ */
+template <typename T, uint16_t N>
+class SpscRing
+{
+private:
+    static_assert(std::has_single_bit(N), "The capacity should be a power of 2");
+
+    T buffer[N];
+    std::atomic<uint32_t> head{0}; // Next slot to write, written by the producer
+    std::atomic<uint32_t> tail{0}; // Next slot to read, written by the consumer
+    std::atomic<uint32_t> overflows{0};
+
+public:
+    /**
+     * @brief Append an element, producer side
+     *
+     * @return false if the ring is full
+     */
+    bool push(const T &item)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+        {
+            overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        buffer[h % N] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest element, consumer side
+     *
+     * @return false if the ring is empty
+     */
+    bool pop(T &item)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+
+        item = buffer[t % N];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Get the oldest element without taking it, consumer side
+     *
+     * @return The element, valid until it's taken, or nullptr if the ring is empty
+     */
+    const T *peek() const
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return nullptr;
+        return &buffer[t % N];
+    }
+
+    /**
+     * @brief Take the newest element and drop the older ones, consumer side
+     *
+     * @return The number of elements taken including the dropped ones, 0 if the ring is empty
+     */
+    uint32_t popLatest(T &item)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        auto h = head.load(std::memory_order_acquire);
+        if (t == h)
+            return 0;
+
+        item = buffer[(h - 1) % N];
+        tail.store(h, std::memory_order_release);
+        return h - t;
+    }
+
+    /** Number of elements waiting, exact on the consumer side only */
+    inline uint32_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+    }
+
+    /** Number of elements rejected because the ring was full */
+    inline uint32_t getOverflows() const
+    {
+        return overflows.load(std::memory_order_relaxed);
+    }
+};
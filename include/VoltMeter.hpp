@@ -1,31 +1,58 @@
 #pragma once
 
-#include <Arduino.h>
+#include <algorithm>
+#include <bit>
+#include <span>
 #include <utility>
-#include <ulog.h>
 
+#include "config.h"
+#include "AdcCorrection.h"
+#include "AdcSampler.h"
+#include "Calibration.hpp"
+#include "Filters.hpp"
+#include "FixedPoint.hpp"
+#include "Hal.h"
+#include "Log.h"
+#include "Perf.h"
+
+/**
+ * @brief A voltage channel with a switchable-gain amplifier
+ *
+ * @tparam Filter The filter policy for smoothing the samples, see Filters.hpp
+ * @tparam N_SAMPLES The window length (or the decimation ratio) of the filter
+ */
+template <template <uint16_t> class Filter, uint16_t N_SAMPLES>
 class VoltMeter
 {
 private:
-    uint32_t adcPin;
+    uint32_t adcChannel; // Position of the channel in the interleaved sample blocks
     uint32_t scale0Pin;
     uint32_t scale1Pin;
+    uint32_t scalePinMask;
 
     uint8_t activeScale = 0;
-    float scaleGains[4];
+    uint32_t scaleGains[4]{0}; // Q16.16, for the range selection
+    ScaleCalibration calibrations[4];
+
+    // Auto-ranging
+    bool autoRange = true;
+    bool overloaded = false;
+    uint32_t enterCodes[4][4]{0}; // Peak code on scale [from] below which scale [to] can be entered
+
+    // Samples to discard while the amplifier output settles after a scale change
+    static constexpr uint32_t CHANNEL_RATE = ADC_SAMPLE_RATE / AdcSampler::CHANNEL_COUNT;
+    uint32_t settleSamples = 0;
 
-    // Sample buffer for voltage smoothing
-    static constexpr uint8_t N_SAMPLES = 20;
-    uint16_t readBuffer[N_SAMPLES]{0};
-    uint8_t bufferFilled = 0;
+    Filter<N_SAMPLES> filter;
 
 public:
     VoltMeter(uint32_t adc_pin, uint32_t scale_pin0, uint32_t scale_pin1)
-        : adcPin(adc_pin), scale0Pin(scale_pin0), scale1Pin(scale_pin1)
+        : adcChannel(adc_pin - 26), scale0Pin(scale_pin0), scale1Pin(scale_pin1),
+          scalePinMask((1ul << scale_pin0) | (1ul << scale_pin1))
     {
-        pinMode(scale0Pin, OUTPUT);
-        pinMode(scale1Pin, OUTPUT);
-        selectScale(0);
+        Hal::pinOutput(scale0Pin);
+        Hal::pinOutput(scale1Pin);
+        selectScale(0, true);
     }
 
     /**
@@ -39,10 +66,10 @@ public:
      */
     inline void setGains(const float scale0_gain, const float scale1_gain, const float scale2_gain, const float scale3_gain)
     {
-        scaleGains[0] = scale0_gain;
-        scaleGains[1] = scale1_gain;
-        scaleGains[2] = scale2_gain;
-        scaleGains[3] = scale3_gain;
+        setGain(0, FixedPoint::toQ16(scale0_gain));
+        setGain(1, FixedPoint::toQ16(scale1_gain));
+        setGain(2, FixedPoint::toQ16(scale2_gain));
+        setGain(3, FixedPoint::toQ16(scale3_gain));
     }
 
     /**
@@ -52,27 +79,141 @@ public:
      */
     inline void setGains(const float gains[4])
     {
-        memcpy(scaleGains, gains, sizeof(scaleGains));
+        setGains(gains[0], gains[1], gains[2], gains[3]);
+    }
+
+    /**
+     * @brief Declare the actual gain of a scale, as a gain-only calibration
+     *
+     * @param scale The scale number (0-3)
+     * @param gain The gain in Q16.16
+     */
+    inline void setGain(const uint8_t scale, const uint32_t gain)
+    {
+        if (scale > 3)
+            return;
+
+        ScaleCalibration cal;
+        cal.setGain(gain);
+        setCalibration(scale, cal);
+    }
+
+    /**
+     * @brief Set the calibration of a scale
+     *
+     * @param scale The scale number (0-3)
+     * @param cal The calibration
+     */
+    void setCalibration(const uint8_t scale, const ScaleCalibration &cal)
+    {
+        if (scale > 3)
+            return;
+
+        calibrations[scale] = cal;
+        scaleGains[scale] = cal.gain();
+
+        // The code on another scale scales with the gain ratio,
+        // so entering it only below RANGE_ENTER_CODE leaves a band before it would be left again
+        for (uint8_t from = 0; from < 4; from++)
+        {
+            for (uint8_t to = 0; to < 4; to++)
+            {
+                enterCodes[from][to] = scaleGains[to]
+                                           ? static_cast<uint64_t>(RANGE_ENTER_CODE) * scaleGains[from] / scaleGains[to]
+                                           : 0;
+            }
+        }
+    }
+
+    /**
+     * @brief Get the gain of a scale
+     *
+     * @param scale The scale number (0-3)
+     * @return The gain in Q16.16
+     */
+    inline uint32_t getGain(const uint8_t scale)
+    {
+        return scale > 3 ? 0 : scaleGains[scale];
+    }
+
+    /**
+     * @brief Get the calibration of a scale
+     *
+     * @param scale The scale number (0-3)
+     * @return The calibration
+     */
+    inline const ScaleCalibration &getCalibration(const uint8_t scale)
+    {
+        return calibrations[scale & 3];
     }
 
     /**
      * @brief Select the gain of the amplifier
      *
-     *  This will clear the buffer
+     * Both scale pins change in a single register write, so no other gain is passed through.
+     * The samples in the filter are rescaled by the gain ratio, so the reading stays valid,
+     * and the new samples are discarded until the ADC input RC settles, from those the DMA
+     * had already converted on the old gain, see getSettleSamples().
      *
      * @param scale The scale number (0-3)
+     * @param reset Drop the samples instead, e.g. when they're clipped
      */
-    inline void selectScale(const uint8_t scale)
+    inline void selectScale(const uint8_t scale, const bool reset = false)
     {
         if (scale > 3)
             return;
 
-        digitalWrite(scale0Pin, (scale & 1) ? 1 : 0); // Lower bit
-        digitalWrite(scale1Pin, (scale & 2) ? 1 : 0); // Higher bit
-        bufferFilled = 0;                             // Needless to actually modify the buffer
+        // Lower bit on scale0Pin, higher bit on scale1Pin
+        Hal::pinsPut(scalePinMask, ((scale & 1) ? 1ul << scale0Pin : 0) | ((scale & 2) ? 1ul << scale1Pin : 0));
+
+        auto from = scaleGains[activeScale];
+        auto to = scaleGains[scale];
+        if (reset || !from || !to)
+        {
+            filter.reset();
+            settleSamples = getSettleSamples(1 << 12);
+        }
+        else if (scale != activeScale)
+        {
+            auto ratio = static_cast<uint32_t>((static_cast<uint64_t>(to) << 16) / from);
+            auto code = filter.mean() >> 16;
+            auto step = static_cast<uint32_t>(std::abs(static_cast<int32_t>((static_cast<uint64_t>(code) * ratio) >> 16) -
+                                                       static_cast<int32_t>(code)));
+            filter.rescale(ratio);
+            settleSamples = getSettleSamples(step);
+        }
         activeScale = scale;
     }
 
+    /**
+     * @brief Estimate the settling time of the ADC input RC after a step
+     *
+     * The step decays to half an LSB after ln(2 * step) time constants.
+     *
+     * @param step The step in ADC codes
+     * @return The time in microseconds
+     */
+    static constexpr uint32_t settleTime(const uint32_t step)
+    {
+        // ln(x) ~= bit_width(x) * ln(2)
+        return ADC_INPUT_RC_US * std::bit_width(2 * step) * 693 / 1000;
+    }
+
+    /**
+     * @brief Get the samples of this channel to discard after a scale change
+     *
+     * The blocks are taken a task period or more after the DMA started the next one,
+     * so the samples it converted since the last block taken were still on the old gain,
+     * the settling time of the step only starts after them.
+     *
+     * @param step The step in ADC codes
+     */
+    static uint32_t getSettleSamples(const uint32_t step)
+    {
+        auto ahead = (AdcSampler::getSamplesAhead() + AdcSampler::CHANNEL_COUNT - 1) / AdcSampler::CHANNEL_COUNT;
+        return ahead + settleTime(step) * CHANNEL_RATE / 1000000;
+    }
+
     /**
      * @brief Get the active scale
      *
@@ -84,55 +225,141 @@ public:
     }
 
     /**
-     * @brief Get a sample from the ADC and push it into the buffer
+     * @brief Drop the filtered samples and start over on the active scale
      *
-     * Should be called repeatedly with a constant interval
+     * Brings the meter to a known state, e.g. at the start of a capture.
      */
-    void convertOnce()
+    inline void restart()
     {
-        // Shift the samples left
-        for (uint8_t i = 1; i < N_SAMPLES; i++)
+        overloaded = false;
+        selectScale(activeScale, true);
+    }
+
+    inline bool getAutoRange()
+    {
+        return autoRange;
+    }
+
+    /**
+     * @brief Enable or disable the automatic scale selection
+     *
+     * @param enable
+     */
+    inline void setAutoRange(const bool enable)
+    {
+        autoRange = enable;
+        overloaded = false;
+    }
+
+    /**
+     * @brief Select the scale from the peak raw code of a block
+     *
+     * Jumps directly to the target scale instead of stepping:
+     * a saturated peak goes to the lowest gain, otherwise the highest gain which
+     * keeps the peak below RANGE_ENTER_CODE is chosen, and the active scale is
+     * only left for a lower gain once the peak exceeds RANGE_LEAVE_CODE.
+     *
+     * @param peak The highest raw code of the block
+     */
+    void updateRange(const uint16_t peak)
+    {
+        overloaded = false;
+        if (peak >= ADC_SATURATION_CODE)
+        {
+            if (activeScale > 0)
+                selectScale(0, true); // The clipped samples can't be rescaled
+            else
+                overloaded = true;
+            return;
+        }
+
+        uint8_t target = activeScale;
+        if (peak >= RANGE_LEAVE_CODE)
+        {
+            // The highest lower gain which brings the peak back under RANGE_ENTER_CODE
+            target = 0;
+            for (uint8_t s = activeScale - 1; s > 0 && s < activeScale; s--)
+            {
+                if (peak < enterCodes[activeScale][s])
+                {
+                    target = s;
+                    break;
+                }
+            }
+        }
+        else
         {
-            readBuffer[i - 1] = readBuffer[i];
+            // The highest gain which keeps the peak under RANGE_ENTER_CODE
+            for (uint8_t s = 3; s > activeScale; s--)
+            {
+                if (peak < enterCodes[activeScale][s])
+                {
+                    target = s;
+                    break;
+                }
+            }
         }
 
-        readBuffer[N_SAMPLES - 1] = analogRead(adcPin);
-        if (bufferFilled < N_SAMPLES)
-            bufferFilled++;
+        if (target != activeScale)
+            selectScale(target);
     }
 
     /**
-     * @brief Get the raw voltage value from the buffer
+     * @brief Push the samples of this channel in a block into the filter
+     *
+     * Should be called with every block from the ADC sampler
      *
-     * @return Value in volts
+     * @param block The interleaved sample block
+     * @param channelCount The number of channels interleaved in the block
      */
-    float getRawVoltage()
+    void convertBlock(std::span<const uint16_t> block, const size_t channelCount)
     {
-        float val = 0;
-        for (auto &v : readBuffer)
+        uint16_t peak = 0;
+        size_t i = adcChannel;
+        for (; i < block.size() && settleSamples; i += channelCount)
         {
-            val += v;
+            settleSamples--;
         }
-        val /= N_SAMPLES;
-        val *= 3.3 / (1 << ADC_RESOLUTION); // Convert to raw voltage
+        if (i >= block.size()) // Still settling
+            return;
 
-        return val;
+        for (; i < block.size(); i += channelCount)
+        {
+            filter.push(AdcCorrection::apply(block[i]));
+            peak = std::max(peak, block[i]); // Saturation shows on the raw code
+        }
+
+        if (autoRange)
+        {
+            PERF_SCOPE(RANGE);
+            updateRange(peak);
+        }
+    }
+
+    /**
+     * @brief Get the raw voltage value at the ADC pin from the filter
+     *
+     * @return Value in microvolts
+     */
+    uint32_t getRawVoltage()
+    {
+        return FixedPoint::codeToMicrovolts(filter.mean());
     }
 
     /**
-     * @brief Get the smoothed voltage value from the buffer
+     * @brief Get the smoothed voltage value from the filter
      *
-     * Only succeed if the buffer is filled
+     * Only succeed if the filter is settled
      *
-     * @param resolution
-     * @return Value in volts, or -1 if it's invalid
+     * @return Value in microvolts, FixedPoint::INVALID or FixedPoint::OVERLOAD
      */
-    float readVoltage()
+    int32_t readVoltage()
     {
-        if (bufferFilled < N_SAMPLES)
-            return -1;
+        if (overloaded)
+            return FixedPoint::OVERLOAD;
+        if (!filter.ready())
+            return FixedPoint::INVALID;
 
-        auto val = getRawVoltage() / scaleGains[activeScale]; // Apply the gain
-        return val;
+        return calibrations[activeScale].apply(getRawVoltage());
     }
 };
\ No newline at end of file
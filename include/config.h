@@ -26,19 +26,78 @@ constexpr float U_SCALE_DEF_GAINS[] = {0.23, 0.45, 1, 2.14};
 constexpr float I_SCALE_DEF_GAIN[] = {5, 10, 22, 47};
 constexpr float I_SAMPLE_RES = 0.5; // Sample resistor value in Ohms
 
-// Threshold values for each scale
+// Default extra widths of the ADC wide codes in 1/16 LSB, no correction until captured with "cal start adc"
+constexpr int16_t ADC_DEF_SPIKE_WIDTHS[] = {0, 0, 0, 0};
+
+// Nominal range of each scale, the calibration inputs should be within it
 constexpr float U_SCALE_MAX_VALUE[] = {14, 6.5, 3.1, 1.3};
 constexpr float U_SCALE_MIN_VALUE[] = {6, 2.8, 1.1, 0};
 constexpr float I_SCALE_MAX_VALUE[] = {1.4, 0.6, 0.25, 0.12};
 constexpr float I_SCALE_MIN_VALUE[] = {0.5, 0.2, 0.1, 0};
 
-// Some loop period in ms
-constexpr auto SAMPLE_PERIOD = 10;
-constexpr auto GET_VALUE_PERIOD = 500;
+// Reference points of "cal auto", in blocks of the ADC acquisition below and in microvolts at the ADC pin
+constexpr auto CAL_AUTO_DEF_SAMPLES = 100; // 1s
+constexpr auto CAL_AUTO_MAX_SAMPLES = 1000;
+constexpr auto CAL_AUTO_MAX_NOISE_UV = 1000; // Standard deviation of the block means, about 1.2 LSB
+constexpr auto CAL_AUTO_MAX_DRIFT_UV = 300;  // Between the means of the first and the second half
+
+// ADC acquisition
+constexpr auto ADC_SAMPLE_RATE = 40000;     // Total conversions per second, shared by all channels
+constexpr auto ADC_BLOCK_SIZE = 400;        // Samples per DMA block, 10ms at the rate above
+
+// Time constant of the RC filter at the ADC inputs (R21/C11 and R22/C12, 10K 100nF) in us
+constexpr auto ADC_INPUT_RC_US = 1000;
+
+// Auto-ranging thresholds in raw ADC codes
+constexpr auto ADC_SATURATION_CODE = 4080; // Clipped, the input is beyond the scale
+constexpr auto RANGE_LEAVE_CODE = 3900;    // Switch to a lower gain above this
+constexpr auto RANGE_ENTER_CODE = 3300;    // Switch to a higher gain only if it stays below this
+
+// Filter lengths in samples of each channel, the filter types are chosen in Meters.hpp
+constexpr auto U_FILTER_SAMPLES = 4000; // Boxcar window, 200ms
+constexpr auto I_FILTER_SAMPLES = 4096; // EMA time constant, about 200ms
+
+// Task periods in ms
+constexpr auto SAMPLE_TASK_PERIOD = 5; // Half a block, so every block is processed before the DMA wraps back to it
+constexpr auto GET_VALUE_PERIOD = 100; // Readout rate, only the changed digits are redrawn
 constexpr auto LVGL_HANDLE_PERIOD = 5;
 constexpr auto CONSOLE_HANDLE_PERIOD = 15;
+constexpr auto HEAP_CHECK_PERIOD = 1000;
+
+// Keys, scanned by a timer interrupt, in ms
+constexpr auto KEY_SCAN_PERIOD = 5;
+constexpr auto KEY_DEBOUNCE_SCANS = 4; // The level should hold for as many scans to be taken, 20ms
+constexpr auto KEY_LONG_PRESS_TIME = 500; // Above the LVGL long press time, the LVGL indev acts on this event
+constexpr auto KEY_REPEAT_PERIOD = 150;   // Above the LVGL repeat time, as above
+constexpr auto KEY_QUEUE_LENGTH = 16;     // Key events waiting for the UI
+
+// Measurements queued from core 0 to the UI, 1.6s at the value period
+constexpr auto DISPLAY_QUEUE_LENGTH = 16;
+
+// Buckets kept of each history level, a point each on the trend chart: 2 min, 2 h and 5 days
+constexpr auto HISTORY_LENGTH = 120;
+
+// Character cells of a readout, "-123.45 V" or "Overload"
+constexpr auto READOUT_CELLS = 9;
+
+// Panic on any C++ heap allocation after the setup instead of counting it, for debugging
+constexpr auto HEAP_GUARD_PANIC = false;
+
+// Binary streaming (capture and stream), free room in the serial transmit buffer (USB CDC) needed for writing a record
+constexpr auto SERIAL_TX_ROOM = 256;
+
+// SCPI
+constexpr auto SCPI_IDN = "redstonee,RP2040-UI_Meter,0,1.0"; // Manufacturer, model, serial number, firmware
+constexpr auto SCPI_MAX_AVERAGE = 16;                         // Readings kept for the averaging, 1.6s at the value period
+constexpr auto SCPI_ERROR_QUEUE_LENGTH = 8;
+constexpr auto SCPI_RESPONSE_LENGTH = 128; // The responses of a line
 
 // Console
 constexpr auto LOG_LEVEL = ULOG_INFO_LEVEL;
+constexpr auto LOG_QUEUE_LENGTH = 32; // Records of each core waiting for the serial port
+constexpr auto LOG_ARG_BYTES = 48;    // Room for the arguments of a record, strings included
+constexpr auto LOG_LINE_LENGTH = 160;
 constexpr auto CONSOLE_PROMPT = "8=> ";
-constexpr auto CONSOLE_BUFFER_SIZE = 64;
\ No newline at end of file
+constexpr auto CONSOLE_BUFFER_SIZE = 64;
+constexpr auto CONSOLE_MAX_ARGS = 8; // Including the command name
+constexpr auto CONSOLE_MAX_COMMANDS = 16;
\ No newline at end of file
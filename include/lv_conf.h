@@ -514,7 +514,7 @@
 
 #define LV_USE_CANVAS     0
 
-#define LV_USE_CHART      0
+#define LV_USE_CHART      1
 
 #define LV_USE_CHECKBOX   0
 
@@ -570,7 +570,7 @@
 
 #define LV_USE_TABVIEW    0
 
-#define LV_USE_TILEVIEW   0
+#define LV_USE_TILEVIEW   1
 
 #define LV_USE_WIN        0
 
@@ -0,0 +1,92 @@
+#include "AdcCorrection.h"
+#include "Log.h"
+
+namespace AdcCorrection
+{
+    // The histogram covers this many codes on each side of the wide codes
+    constexpr uint8_t HALF_WINDOW = 16;
+    // Around a wide code, the neighbours are often narrow, so they're counted into its width
+    constexpr uint8_t SPIKE_SPAN = 1;
+    // Minimum average hits per code for a meaningful width
+    constexpr uint32_t MIN_HITS = 32;
+
+    uint16_t table[1 << 12];
+
+    static uint32_t histogram[SPIKE_COUNT][2 * HALF_WINDOW + 1];
+
+    void setSpikeWidths(const int16_t widths[SPIKE_COUNT])
+    {
+        int32_t offset = 0; // In 1/16 LSB
+        uint8_t spike = 0;
+        for (uint16_t code = 0; code < (1 << 12); code++)
+        {
+            int32_t correction = offset;
+            if (spike < SPIKE_COUNT && code == SPIKE_CODES[spike])
+            {
+                correction += widths[spike] / 2; // The center of the wide code
+                offset += widths[spike];
+                spike++;
+            }
+
+            int32_t corrected = (static_cast<int32_t>(code) << WIDTH_FRAC_BITS) + correction;
+            corrected = (corrected + (1 << (WIDTH_FRAC_BITS - 1))) >> WIDTH_FRAC_BITS; // Round
+            table[code] = corrected < 0 ? 0 : corrected;
+        }
+    }
+
+    void startCapture()
+    {
+        for (auto &h : histogram)
+        {
+            for (auto &c : h)
+                c = 0;
+        }
+    }
+
+    void feedCapture(std::span<const uint16_t> block, const size_t channel, const size_t channelCount)
+    {
+        for (size_t i = channel; i < block.size(); i += channelCount)
+        {
+            // The wide codes are in the middle of every 1024 codes
+            uint16_t spike = block[i] >> 10;
+            if (spike >= SPIKE_COUNT)
+                continue;
+
+            int32_t pos = static_cast<int32_t>(block[i]) - SPIKE_CODES[spike] + HALF_WINDOW;
+            if (pos >= 0 && pos <= 2 * HALF_WINDOW)
+                histogram[spike][pos]++;
+        }
+    }
+
+    bool finishCapture(int16_t widths[SPIKE_COUNT])
+    {
+        for (uint8_t spike = 0; spike < SPIKE_COUNT; spike++)
+        {
+            uint32_t neighbourHits = 0;
+            uint32_t spanHits = 0;
+            for (int8_t i = -HALF_WINDOW; i <= HALF_WINDOW; i++)
+            {
+                auto hits = histogram[spike][i + HALF_WINDOW];
+                if (i >= -SPIKE_SPAN && i <= SPIKE_SPAN)
+                    spanHits += hits;
+                else
+                    neighbourHits += hits;
+            }
+
+            constexpr uint32_t neighbourCount = 2 * (HALF_WINDOW - SPIKE_SPAN);
+            if (neighbourHits < MIN_HITS * neighbourCount)
+            {
+                ULOG_WARNING("Not enough samples around code %u, keep the ramp running",
+                             static_cast<unsigned>(SPIKE_CODES[spike]));
+                return false;
+            }
+
+            // Width of the span in LSB minus its code count, in 1/16 LSB
+            constexpr uint32_t spanCount = 2 * SPIKE_SPAN + 1;
+            int64_t extra = (static_cast<int64_t>(spanHits) * neighbourCount << WIDTH_FRAC_BITS) / neighbourHits;
+            widths[spike] = extra - (spanCount << WIDTH_FRAC_BITS);
+        }
+        return true;
+    }
+
+} // namespace AdcCorrection
@@ -0,0 +1,164 @@
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+
+#include "AdcSampler.h"
+#include "config.h"
+#include "Log.h"
+
+namespace AdcSampler
+{
+    static_assert(ADC_BLOCK_SIZE % CHANNEL_COUNT == 0, "The block size should be a multiple of the channel count");
+
+    constexpr uint32_t ADC_CLOCK = 48000000;
+    constexpr uint32_t ADC_CONVERSION_CYCLES = 96;
+    constexpr auto FIRST_ADC_PIN = 26;
+
+    static uint16_t blocks[2][ADC_BLOCK_SIZE];
+    static uint dmaChannels[2];
+
+    // Written by the DMA interrupt only
+    static volatile uint32_t blocksCompleted = 0;
+    static uint32_t blocksConsumed = 0;
+    static uint32_t droppedBlocks = 0;
+    static bool running = false;
+    static bool paused = false;
+
+    /**
+     * @brief The DMA interrupt handler, re-arms the finished channel
+     *
+     * The other channel is already running since it's chained, so the
+     * finished one only needs its write address reset for the next round.
+     */
+    static void onBlockComplete()
+    {
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            if (dma_channel_get_irq1_status(dmaChannels[i]))
+            {
+                dma_channel_acknowledge_irq1(dmaChannels[i]);
+                dma_channel_set_write_addr(dmaChannels[i], blocks[i], false);
+                blocksCompleted = blocksCompleted + 1;
+            }
+        }
+    }
+
+    void init(const uint32_t sampleRate)
+    {
+        if (sampleRate == 0 || sampleRate > ADC_CLOCK / ADC_CONVERSION_CYCLES)
+        {
+            ULOG_ERROR("Unable to start the ADC: invalid sample rate %u", sampleRate);
+            return;
+        }
+
+        adc_init();
+        adc_gpio_init(USENSE_PIN);
+        adc_gpio_init(ISENSE_PIN);
+        adc_select_input(0);
+        adc_set_round_robin((1 << (USENSE_PIN - FIRST_ADC_PIN)) | (1 << (ISENSE_PIN - FIRST_ADC_PIN)));
+        adc_fifo_setup(true, true, 1, false, false); // 12-bit results, DREQ on every sample
+        adc_set_clkdiv(static_cast<float>(ADC_CLOCK) / sampleRate - 1);
+
+        dmaChannels[0] = dma_claim_unused_channel(true);
+        dmaChannels[1] = dma_claim_unused_channel(true);
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            auto config = dma_channel_get_default_config(dmaChannels[i]);
+            channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+            channel_config_set_read_increment(&config, false);
+            channel_config_set_write_increment(&config, true);
+            channel_config_set_dreq(&config, DREQ_ADC);
+            channel_config_set_chain_to(&config, dmaChannels[i ^ 1]); // Ping-pong
+            dma_channel_configure(dmaChannels[i], &config, blocks[i], &adc_hw->fifo, ADC_BLOCK_SIZE, false);
+            dma_channel_set_irq1_enabled(dmaChannels[i], true);
+        }
+
+        irq_add_shared_handler(DMA_IRQ_1, onBlockComplete, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+
+        dma_channel_start(dmaChannels[0]);
+        adc_run(true);
+        running = true;
+    }
+
+    std::span<const uint16_t> getBlock()
+    {
+        auto completed = blocksCompleted;
+        if (completed == blocksConsumed)
+            return {};
+
+        // Only the latest block is intact if we fell behind
+        if (completed - blocksConsumed > 1)
+        {
+            droppedBlocks += completed - blocksConsumed - 1;
+            blocksConsumed = completed - 1;
+        }
+
+        return {blocks[blocksConsumed++ & 1], ADC_BLOCK_SIZE};
+    }
+
+    uint32_t getSamplesAhead()
+    {
+        if (!running)
+            return 0;
+
+        // The channel writing the next block, read again if a block completed in between
+        uint32_t completed;
+        uint32_t remaining;
+        do
+        {
+            completed = blocksCompleted;
+            remaining = dma_channel_hw_addr(dmaChannels[completed & 1])->transfer_count;
+        } while (completed != blocksCompleted);
+        return (completed - blocksConsumed) * ADC_BLOCK_SIZE + ADC_BLOCK_SIZE - remaining;
+    }
+
+    uint32_t getDroppedBlocks()
+    {
+        return droppedBlocks;
+    }
+
+    void pause()
+    {
+        if (!running)
+            return;
+
+        adc_run(false);
+
+        // An aborted channel may still raise its interrupt, so they're masked during the abort
+        for (uint8_t i = 0; i < 2; i++)
+            dma_channel_set_irq1_enabled(dmaChannels[i], false);
+        dma_channel_abort(dmaChannels[0]);
+        dma_channel_abort(dmaChannels[1]);
+        for (uint8_t i = 0; i < 2; i++)
+            dma_channel_acknowledge_irq1(dmaChannels[i]);
+
+        // The conversion in progress lands in the FIFO
+        while (!(adc_hw->cs & ADC_CS_READY_BITS))
+            tight_loop_contents();
+        adc_fifo_drain();
+        running = false;
+        paused = true;
+    }
+
+    void resume()
+    {
+        if (!paused)
+            return;
+
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            dma_channel_set_write_addr(dmaChannels[i], blocks[i], false);
+            dma_channel_set_trans_count(dmaChannels[i], ADC_BLOCK_SIZE, false);
+            dma_channel_set_irq1_enabled(dmaChannels[i], true);
+        }
+
+        // The blocks start with the lowest input again
+        adc_select_input(0);
+        dma_channel_start(dmaChannels[blocksCompleted & 1]);
+        adc_run(true);
+        running = true;
+        paused = false;
+    }
+
+} // namespace AdcSampler
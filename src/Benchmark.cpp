@@ -0,0 +1,92 @@
+#ifdef METER_BENCHMARK
+
+#include <Arduino.h>
+
+#include "Benchmark.h"
+#include "Console.h"
+#include "config.h"
+#include "Calibration.hpp"
+#include "Filters.hpp"
+#include "FixedPoint.hpp"
+#include "Log.h"
+
+extern "C"
+{
+    extern const char help_bench[];
+}
+
+namespace Benchmark
+{
+    constexpr auto ITERATIONS = 1000;
+    constexpr uint16_t TEST_CODE = 2345;
+    constexpr float TEST_GAIN = U_SCALE_DEF_GAINS[2];
+
+    static BoxcarFilter<U_FILTER_SAMPLES> filter;
+
+    /**
+     * @brief One reading the way it was done with floats: average, gain and range check
+     */
+    static bool __attribute__((noinline)) readFloat(const uint32_t sum, const float gain)
+    {
+        float val = static_cast<float>(sum) / U_FILTER_SAMPLES;
+        val *= 3.3 / 4096;
+        val /= gain;
+        return val > U_SCALE_MAX_VALUE[2];
+    }
+
+    /**
+     * @brief The same reading in fixed point
+     */
+    static bool __attribute__((noinline)) readFixed(const BoxcarFilter<U_FILTER_SAMPLES> &f, const ScaleCalibration &cal)
+    {
+        constexpr auto maxValue = FixedPoint::toMicro(U_SCALE_MAX_VALUE[2]);
+        return cal.apply(FixedPoint::codeToMicrovolts(f.mean())) > maxValue;
+    }
+
+    static void cmdBenchCallback(Console::Args args)
+    {
+        for (auto i = 0; i < U_FILTER_SAMPLES; i++)
+            filter.push(TEST_CODE);
+
+        volatile uint32_t sum = static_cast<uint32_t>(TEST_CODE) * U_FILTER_SAMPLES;
+        volatile float gain = TEST_GAIN;
+        ScaleCalibration cal;
+        cal.setGain(FixedPoint::toQ16(TEST_GAIN));
+        volatile bool result;
+
+        auto t0 = rp2040.getCycleCount();
+        for (auto i = 0; i < ITERATIONS; i++)
+            result = readFloat(sum, gain);
+        auto floatCycles = rp2040.getCycleCount() - t0;
+
+        t0 = rp2040.getCycleCount();
+        for (auto i = 0; i < ITERATIONS; i++)
+            result = readFixed(filter, cal);
+        auto fixedCycles = rp2040.getCycleCount() - t0;
+        (void)result;
+
+        ULOG_INFO("Cycles per reading: float %u, fixed %u",
+                  static_cast<unsigned>(floatCycles / ITERATIONS), static_cast<unsigned>(fixedCycles / ITERATIONS));
+    }
+
+    void init()
+    {
+        Console::Command benchCmd{"bench", help_bench, 0, 0, cmdBenchCallback};
+        Console::registerCommand(benchCmd);
+    }
+
+} // namespace Benchmark
+
+#else
+
+#include "Benchmark.h"
+
+namespace Benchmark
+{
+    void init()
+    {
+    }
+
+} // namespace Benchmark
+
+#endif
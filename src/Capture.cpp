@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cstring>
+
+#include "AdcSampler.h"
+#include "Capture.h"
+#include "Hal.h"
+#include "Log.h"
+#include "SerialTakeover.h"
+
+namespace Capture
+{
+    static bool active = false;
+    static Header pendingHeader; // Written with the first block
+    static uint32_t blocksLeft = 0; // 0 for no limit
+    static uint32_t sequence = 0;
+    static uint32_t written = 0;
+    static uint32_t dropped = 0;
+
+    void pack(std::span<const uint16_t> codes, uint8_t *out)
+    {
+        for (std::size_t i = 0; i + 1 < codes.size(); i += 2, out += 3)
+        {
+            out[0] = codes[i];
+            out[1] = (codes[i] >> 8 & 0x0F) | (codes[i + 1] << 4 & 0xF0);
+            out[2] = codes[i + 1] >> 4;
+        }
+    }
+
+    void unpack(const uint8_t *in, std::span<uint16_t> codes)
+    {
+        for (std::size_t i = 0; i + 1 < codes.size(); i += 2, in += 3)
+        {
+            codes[i] = in[0] | (in[1] & 0x0F) << 8;
+            codes[i + 1] = in[1] >> 4 | in[2] << 4;
+        }
+    }
+
+    void setCalibrations(Header &header, const ScaleCalibration (&uCals)[4], const ScaleCalibration (&iCals)[4])
+    {
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            header.uPointCounts[s] = uCals[s].getCount();
+            header.iPointCounts[s] = iCals[s].getCount();
+            for (uint8_t i = 0; i < CAL_POINTS; i++)
+            {
+                header.uPoints[s][i] = i < uCals[s].getCount() ? uCals[s].getPoint(i) : CalPoint{};
+                header.iPoints[s][i] = i < iCals[s].getCount() ? iCals[s].getPoint(i) : CalPoint{};
+            }
+        }
+    }
+
+    void getCalibrations(const Header &header, ScaleCalibration (&uCals)[4], ScaleCalibration (&iCals)[4])
+    {
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            uCals[s].clear();
+            iCals[s].clear();
+            for (uint8_t i = 0; i < std::min(header.uPointCounts[s], CAL_POINTS); i++)
+                uCals[s].addPoint(header.uPoints[s][i].raw, header.uPoints[s][i].value);
+            for (uint8_t i = 0; i < std::min(header.iPointCounts[s], CAL_POINTS); i++)
+                iCals[s].addPoint(header.iPoints[s][i].raw, header.iPoints[s][i].value);
+        }
+    }
+
+    /**
+     * @brief Write the end record and give the serial port back to the console
+     */
+    static void stop()
+    {
+        EndRecord end{.marker = Marker::END, .reserved = {}, .blocks = written, .dropped = dropped};
+        SerialTakeover::write(&end, sizeof(end));
+
+        active = false;
+        SerialTakeover::release();
+        ULOG_INFO("Capture finished, %u blocks, %u dropped", static_cast<unsigned>(written), static_cast<unsigned>(dropped));
+    }
+
+    void start(Header &header, const uint32_t maxBlocks)
+    {
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.channelCount = AdcSampler::CHANNEL_COUNT;
+        header.blockSize = ADC_BLOCK_SIZE;
+        header.sampleRate = ADC_SAMPLE_RATE;
+        header.reserved = 0;
+
+        pendingHeader = header;
+        SerialTakeover::take(&pendingHeader, sizeof(pendingHeader));
+        blocksLeft = maxBlocks;
+        sequence = 0;
+        written = 0;
+        dropped = 0;
+        active = true;
+    }
+
+    void writeBlock(std::span<const uint16_t> block, const uint8_t uScale, const uint8_t iScale,
+                    const int32_t uValue, const int32_t iValue)
+    {
+        if (!active)
+            return;
+
+        if (!SerialTakeover::nextBlock())
+        {
+            stop();
+            return;
+        }
+
+        static BlockRecord record;
+        if (!SerialTakeover::canWrite(sizeof(record)))
+        {
+            dropped++;
+            sequence++;
+        }
+        else
+        {
+            record.marker = Marker::BLOCK;
+            record.scales = uScale | iScale << 2;
+            record.reserved = 0;
+            record.sequence = sequence++;
+            record.timestamp = Hal::micros();
+            record.uValue = uValue;
+            record.iValue = iValue;
+            pack(block, record.codes);
+            SerialTakeover::write(&record, sizeof(record));
+            written++;
+        }
+
+        if (blocksLeft && !--blocksLeft)
+            stop();
+    }
+
+    bool isActive()
+    {
+        return active;
+    }
+
+} // namespace Capture
@@ -1,8 +1,11 @@
-#include <ulog.h>
-#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 #include "Console.h"
+#include "Hal.h"
 #include "config.h"
+#include "Log.h"
 
 extern "C"
 {
@@ -11,110 +14,256 @@ extern "C"
 
 namespace Console
 {
-    static char buffer[CONSOLE_BUFFER_SIZE];
+    static char buffer[CONSOLE_BUFFER_SIZE + 1]; // Room for a null character after the line
     static auto bufferPos = 0;
-    static std::vector<Command> commands;
+    static Command commands[CONSOLE_MAX_COMMANDS];
+    static uint8_t commandCount = 0;
+    static LineHandler lineHandler;
+    static bool remote = false;
+    static bool logMuted = false;
+
+    /**
+     * @brief Look for a command by bisection
+     *
+     * @param table The commands, sorted by name
+     * @param name The name
+     * @return The command, or nullptr if not found
+     */
+    static const Command *find(std::span<const Command> table, const std::string_view name)
+    {
+        auto it = std::lower_bound(table.begin(), table.end(), name, [](const Command &c, const std::string_view n)
+                                   { return std::string_view(c.name) < n; });
+        return it != table.end() && name == it->name ? &*it : nullptr;
+    }
 
     /**
      * @brief Callback for the help command
      *
      * @param args
      */
-    static void cmdHelpCallback(std::span<String> args)
+    static void cmdHelpCallback(Args args)
     {
         if (args.size() == 1)
         {
-            for (auto &cmd : commands)
+            for (auto &cmd : std::span(commands, commandCount))
             {
-                Serial.printf("%s - %s\n", cmd.name, cmd.help);
+                Hal::serialPrintf("%s - %s\n", cmd.name, cmd.help);
             }
         }
         else
         {
-            bool found = false;
-            for (auto &cmd : commands)
-            {
-                if (cmd.name == args[1])
-                {
-                    found = true;
-                    Serial.printf("%s - %s\n", cmd.name, cmd.help);
-                    break;
-                }
-            }
-            if (!found)
+            auto cmd = find(std::span(commands, commandCount), args[1].view());
+            if (cmd)
+                Hal::serialPrintf("%s - %s\n", cmd->name, cmd->help);
+            else
                 ULOG_WARNING("Unknown command: %s", args[1].c_str());
         }
     }
 
     void init()
     {
-        Serial.setTimeout(20);
-        Serial.begin(115200);
-        static auto logOutput = [](ulog_level_t level, char *msg)
-        {
-            Serial.printf("[%d] ", millis());
-            Serial.print(ulog_level_name(level));
-            Serial.print(": ");
-            Serial.println(msg);
-        };
-        ulog_subscribe(logOutput, LOG_LEVEL);
-
+        Hal::serialBegin(115200);
         Command helpCmd{"help", help_help, 0, 1, cmdHelpCallback};
         registerCommand(helpCmd);
     }
 
-    void registerCommand(const Command &cmd)
+    void setLogMuted(const bool muted)
     {
-        if (cmd.maxArgCount < cmd.minArgCount)
+        logMuted = muted;
+        Log::setMuted(logMuted || remote);
+    }
+
+    void setLineHandler(LineHandler handler)
+    {
+        lineHandler = handler;
+    }
+
+    void setRemote(const bool r)
+    {
+        remote = r;
+        Log::setMuted(logMuted || remote);
+    }
+
+    bool Arg::validate(const ArgSpec &spec)
+    {
+        char *end;
+        switch (spec.type)
         {
-            ULOG_ERROR("Unable to register command: %s, minArgCount is greater than maxArgCount", cmd.name);
-            return;
+        case ArgType::INT:
+        {
+            auto v = std::strtol(str.data(), &end, 10);
+            if (end == str.data() || *end || v < spec.min || v > spec.max)
+            {
+                ULOG_WARNING("Invalid %s: %s, an integer from %ld to %ld", spec.name, c_str(), spec.min, spec.max);
+                return false;
+            }
+            return true;
         }
 
-        for (auto &c : commands)
+        case ArgType::FLOAT:
         {
-            if (cmd.name == c.name)
+            auto v = std::strtof(str.data(), &end);
+            if (end == str.data() || *end || !(v >= spec.minFloat && v <= spec.maxFloat))
             {
-                ULOG_ERROR("Unable to register command: %s, command already exists", cmd.name);
-                return;
+                ULOG_WARNING("Invalid %s: %s, a number from %g to %g", spec.name, c_str(), spec.minFloat, spec.maxFloat);
+                return false;
+            }
+            return true;
+        }
+
+        case ArgType::CHOICE:
+        {
+            for (uint8_t i = 0; i < spec.choices.size(); i++)
+            {
+                if (str == spec.choices[i])
+                {
+                    choice = i;
+                    return true;
+                }
             }
+
+            char list[CONSOLE_BUFFER_SIZE] = "";
+            std::size_t len = 0;
+            for (auto c : spec.choices)
+                len = std::min(len + snprintf(list + len, sizeof(list) - len, "%s%s", len ? "|" : "", c), sizeof(list) - 1);
+            ULOG_WARNING("Invalid %s: %s, one of %s", spec.name, c_str(), list);
+            return false;
         }
 
-        if (!cmd.cb)
+        default:
+            return true;
+        }
+    }
+
+    /**
+     * @brief Check a command before registering it, and its subcommands
+     *
+     * @return true if valid, the reason is logged otherwise
+     */
+    static bool checkCommand(const Command &cmd)
+    {
+        if (cmd.maxArgCount < cmd.minArgCount)
+        {
+            ULOG_ERROR("Unable to register command: %s, minArgCount is greater than maxArgCount", cmd.name);
+            return false;
+        }
+
+        if (!cmd.cb && cmd.subcommands.empty())
         {
             ULOG_ERROR("Unable to register command: %s, callback is empty", cmd.name);
+            return false;
+        }
+
+        if (!isSorted(cmd.subcommands))
+        {
+            ULOG_ERROR("Unable to register command: %s, subcommands not sorted by name", cmd.name);
+            return false;
+        }
+
+        return std::all_of(cmd.subcommands.begin(), cmd.subcommands.end(), checkCommand);
+    }
+
+    void registerCommand(const Command &cmd)
+    {
+        if (!checkCommand(cmd))
+            return;
+
+        if (commandCount >= CONSOLE_MAX_COMMANDS)
+        {
+            ULOG_ERROR("Unable to register command: %s, too many commands", cmd.name);
+            return;
+        }
+
+        if (find(std::span(commands, commandCount), cmd.name))
+        {
+            ULOG_ERROR("Unable to register command: %s, command already exists", cmd.name);
             return;
         }
 
-        commands.push_back(cmd);
+        // Inserted in order, the registrations happen only during the setup
+        auto pos = commandCount;
+        for (; pos && std::string_view(cmd.name) < commands[pos - 1].name; pos--)
+            commands[pos] = commands[pos - 1];
+        commands[pos] = cmd;
+        commandCount++;
     }
 
     /**
-     * @brief Parse the command line arguments from the buffer
+     * @brief Split a line into arguments, in place
      *
-     * @return std::vector<String> The parsed arguments, first element is the command
+     * @param line The line, the separators are replaced with null characters, with room for one after it
+     * @param len The line length
+     * @param args The arguments found, the first one is the command
+     * @return The argument count, CONSOLE_MAX_ARGS + 1 if there are too many
      */
-    static std::vector<String> parseArgs()
+    static std::size_t parseArgs(char *line, const std::size_t len, Arg (&args)[CONSOLE_MAX_ARGS])
     {
-        char str[CONSOLE_BUFFER_SIZE];
-        strncpy(str, buffer, bufferPos + 1);
-        str[bufferPos] = '\0';
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < len; i++)
+        {
+            if (line[i] == ' ')
+                continue;
+
+            if (count == CONSOLE_MAX_ARGS)
+                return CONSOLE_MAX_ARGS + 1;
+            auto start = i;
+            while (i < len && line[i] != ' ')
+                i++;
+            line[i] = '\0';
+            args[count++] = Arg(line + start, i - start);
+        }
+        return count;
+    }
 
-        std::vector<String> args;
-        char *token = strtok(str, " ");
-        while (token)
+    /**
+     * @brief Validate the arguments and run the command, or look for its subcommand
+     *
+     * @param table The commands, sorted by name
+     * @param args All the arguments of the line
+     * @param depth The index of the command name in the arguments
+     */
+    static void dispatch(std::span<const Command> table, std::span<Arg> args, const std::size_t depth)
+    {
+        auto cmd = find(table, args[depth].view());
+        if (!cmd)
+        {
+            if (depth)
+                ULOG_WARNING("Unknown subcommand of %s: %s", args[depth - 1].c_str(), args[depth].c_str());
+            else
+                ULOG_WARNING("Unknown command: %s, try 'help'", args[0].c_str());
+            return;
+        }
+
+        auto params = args.subspan(depth + 1);
+        if (!cmd->subcommands.empty() && (!params.empty() || !cmd->cb))
         {
-            args.push_back(token);
-            token = strtok(NULL, " ");
+            if (params.empty())
+                ULOG_WARNING("Missing subcommand of %s", cmd->name);
+            else
+                dispatch(cmd->subcommands, args, depth + 1);
+            return;
         }
-        return args;
+
+        if (params.size() < cmd->minArgCount || params.size() > cmd->maxArgCount)
+        {
+            ULOG_WARNING("Invalid argument count for command: %s", cmd->name);
+            return;
+        }
+
+        for (std::size_t i = 0; i < std::min(params.size(), cmd->argSpecs.size()); i++)
+        {
+            if (!params[i].validate(cmd->argSpecs[i]))
+                return;
+        }
+
+        cmd->cb(args);
     }
 
     void handleConsoleEvent()
     {
-        while (Serial.available())
+        for (int r = Hal::serialRead(); r >= 0; r = Hal::serialRead())
         {
-            char c = Serial.read();
+            char c = r;
             if (bufferPos >= CONSOLE_BUFFER_SIZE)
             {
                 bufferPos = 0;
@@ -124,44 +273,57 @@ namespace Console
             {
                 if (bufferPos > 0)
                 {
-                    Serial.print("\b \b");
+                    if (!remote)
+                        Hal::serialWrite("\b \b");
                     bufferPos--;
                 }
             }
             else
             {
-                Serial.print(c); // Echo
-                if (c == '\r')   // Carriage return
+                // No command starts with '*', the line is for the handler (SCPI common commands), so a program
+                // opening with one, e.g. *IDN?, doesn't get the echo of its first line
+                if (c == '*' && bufferPos == 0 && lineHandler)
+                    setRemote(true);
+
+                if (!remote)
+                    Hal::serialWrite(&c, 1); // Echo
+                if (c == '\r')                // Carriage return
                     continue;
 
                 if (c == '\n') // Enter
                 {
-                    if (bufferPos == 0) // Nothing to process
+                    buffer[bufferPos] = '\0';
+                    std::string_view text(buffer, bufferPos);
+                    bufferPos = 0;
+                    auto start = std::min(text.find_first_not_of(' '), text.size());
+                    auto name = text.substr(start, text.find(' ', start) - start);
+                    if (name.empty()) // Nothing to process
                     {
-                        Serial.print(CONSOLE_PROMPT);
+                        if (!remote)
+                            Hal::serialWrite(CONSOLE_PROMPT);
                         continue;
                     }
 
-                    auto args = parseArgs();
-                    bool found = false;
-                    for (auto &cmd : commands) // Look for the command
+                    // A line taken by the handler enters the remote mode, unless the handler leaves it.
+                    // The lines of the handler are all taken at once, so the pipelined ones don't wait.
+                    if (!find(std::span(commands, commandCount), name) && lineHandler)
                     {
-                        if (args[0] == cmd.name)
-                        {
-                            found = true;
-                            if (args.size() - 1 < cmd.minArgCount || args.size() - 1 > cmd.maxArgCount)
-                                ULOG_WARNING("Invalid argument count for command: %s", cmd.name);
-                            else
-                                cmd.cb(args);
-
-                            break;
-                        }
+                        setRemote(true);
+                        if (lineHandler(buffer + start, text.size() - start))
+                            continue;
                     }
-                    if (!found)
-                        ULOG_WARNING("Unknown command: %s, try 'help'", args[0].c_str());
 
-                    bufferPos = 0;
-                    Serial.print(CONSOLE_PROMPT);
+                    setRemote(false);
+                    Arg args[CONSOLE_MAX_ARGS];
+                    auto argCount = parseArgs(buffer, text.size(), args);
+                    if (argCount > CONSOLE_MAX_ARGS)
+                        ULOG_WARNING("Too many arguments, at most %u", static_cast<unsigned>(CONSOLE_MAX_ARGS));
+                    else
+                        dispatch(std::span(commands, commandCount), std::span(args, argCount), 0);
+
+                    // The logs of the command come before the prompt
+                    Log::flush();
+                    Hal::serialWrite(CONSOLE_PROMPT);
                     break;
                 }
                 else
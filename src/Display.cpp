@@ -1,8 +1,20 @@
+#include <algorithm>
+#include <cstdio>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
 #include <lvgl.h>
 #include <TFT_eSPI.h>
-#include <ulog.h>
 
 #include "Display.h"
+#include "FixedPoint.hpp"
+#include "History.h"
+#include "Log.h"
+#include "Perf.h"
+#include "Readout.h"
+#include "SpscRing.hpp"
+#include "config.h"
 
 extern "C"
 {
@@ -10,32 +22,279 @@ extern "C"
     LV_IMAGE_DECLARE(darkLogo);
 }
 
+// The DMA channel claimed by TFT_eSPI::initDMA()
+extern int32_t dma_tx_channel;
+
 namespace Display
 {
     static TFT_eSPI screen;
     ReadKeyEventCallback readKeyEventCb;
 
-    static lv_obj_t *vValueLabel;
-    static lv_obj_t *iValueLabel;
+    static Readout vReadout;
+    static Readout iReadout;
+
+    // Measurements from core 0
+    static SpscRing<Measurement, DISPLAY_QUEUE_LENGTH> measurements;
+    static std::atomic<ConsumeMode> consumeMode{ConsumeMode::LATEST};
+    static uint32_t skippedMeasurements = 0;
+
+    // Trend page, a chart of one history level
+    constexpr int32_t TREND_UNIT = 1000; // Micro-units per chart unit, the chart maps the values in 32 bits
+    static lv_obj_t *tileview;
+    static lv_obj_t *readoutTile;
+    static lv_obj_t *trendTile;
+    static lv_obj_t *trendChart;
+    static lv_obj_t *trendLabel;
+    static lv_chart_series_t *trendSeries[History::CHANNEL_COUNT][3]; // Min, mean and max of each channel
+    static History::Level trendLevel = History::SECONDS;
+    static uint32_t trendRevision = UINT32_MAX; // Revision of the level on the chart, UINT32_MAX to redraw
+
+    static lv_display_t *display;
+    static lv_indev_t *keyPadIndev;
+
+    // Waking up core 1, by SEV from core 0, the key interrupt or the alarm of the next LVGL timer
+    static int alarmNum = -1;
+    static volatile bool keyChanged = false;
+    static KeyInput lastKey{}; // Reported again when nothing is queued, LVGL takes no data as a release
+
+    // Flushing, the transfer runs in the background and ends in the DMA interrupt
+    static volatile bool flushing = false;
+    static uint32_t flushStart;
 
-    // Display update flags
-    static bool voltageUpdated = false;
-    static bool currentUpdated = false;
-    static float voltageValue = 0;
-    static float currentValue = 0;
+    // Frame statistics, collected over STATS_PERIOD and published for the "fps" command
+    constexpr uint32_t STATS_PERIOD = 1000;
+    static uint32_t statsStart = 0;
+    static uint32_t frames = 0;
+    static uint32_t flushes = 0;
+    static uint32_t flushTime = 0;
+    static uint32_t maxFlushTime = 0;
+    static uint32_t waitTime = 0; // Rendering blocked by a transfer still in flight
+    static uint32_t sleepTime = 0;
+    static volatile FrameStats frameStats{};
+
+#ifdef PERF_ENABLED
+    static uint32_t refreshStart;
+    static uint32_t refreshWaitTime; // Waiting time within the current refresh
+#endif
+
+    /**
+     * @brief Count the frames, and record the rendering time of a refresh, i.e. the refresh without waiting
+     */
+    static void onRefreshEvent(lv_event_t *ev)
+    {
+        if (lv_event_get_code(ev) == LV_EVENT_REFR_START)
+        {
+#ifdef PERF_ENABLED
+            refreshStart = Perf::now();
+            refreshWaitTime = 0;
+#endif
+            return;
+        }
 
+        frames++;
+#ifdef PERF_ENABLED
+        Perf::record(Perf::LVGL_RENDER, refreshStart + refreshWaitTime);
+#endif
+    }
+
+    /**
+     * @brief The DMA interrupt handler, the buffer can be reused once the transfer is complete
+     */
+    static void onFlushComplete()
+    {
+        if (!dma_channel_get_irq0_status(dma_tx_channel))
+            return;
+
+        dma_channel_acknowledge_irq0(dma_tx_channel);
+        auto duration = time_us_32() - flushStart;
+        flushes++;
+        flushTime += duration;
+        maxFlushTime = std::max(maxFlushTime, duration);
+#ifdef PERF_ENABLED
+        Perf::record(Perf::LVGL_FLUSH, flushStart);
+#endif
+        flushing = false;
+        lv_display_flush_ready(display);
+    }
+
+    /**
+     * @brief Start the transfer of a rendered area, LVGL renders into the other buffer meanwhile
+     */
     inline void flushDisplay(lv_display_t *disp, const lv_area_t *area,
                              uint8_t *px_map)
     {
         uint32_t w = lv_area_get_width(area);
         uint32_t h = lv_area_get_height(area);
 
-        screen.startWrite();
+        // The write transaction is kept open, the screen is alone on its bus
+        flushStart = time_us_32();
+        flushing = true;
         screen.setAddrWindow(area->x1, area->y1, w, h);
         screen.pushPixelsDMA((uint16_t *)px_map, w * h);
-        screen.endWrite();
+    }
+
+    /**
+     * @brief Sleep until the transfer in flight is complete, when LVGL needs its buffer
+     */
+    static void waitFlush(lv_display_t *disp)
+    {
+        auto start = time_us_32();
+        while (flushing)
+            __wfe();
 
-        lv_disp_flush_ready(disp);
+        auto duration = time_us_32() - start;
+        waitTime += duration;
+#ifdef PERF_ENABLED
+        refreshWaitTime += duration;
+#endif
+    }
+
+    /**
+     * @brief Publish the frame statistics every STATS_PERIOD
+     */
+    static void updateFrameStats()
+    {
+        auto now = millis();
+        auto elapsed = now - statsStart;
+        if (elapsed < STATS_PERIOD)
+            return;
+
+        // A flush may complete meanwhile, so the interrupt is masked for the snapshot
+        irq_set_enabled(DMA_IRQ_0, false);
+        frameStats.fps10 = frames * 10000 / elapsed;
+        frameStats.avgFlushUs = flushes ? flushTime / flushes : 0;
+        frameStats.maxFlushUs = maxFlushTime;
+        frameStats.waitPermille = waitTime / elapsed;
+        frameStats.sleepPermille = sleepTime / elapsed;
+        frames = 0;
+        flushes = 0;
+        flushTime = 0;
+        maxFlushTime = 0;
+        waitTime = 0;
+        sleepTime = 0;
+        irq_set_enabled(DMA_IRQ_0, true);
+        statsStart = now;
+    }
+
+    static void onAlarm(uint alarm)
+    {
+        // Wake up the core even if it's just about to sleep
+        __sev();
+    }
+
+    /**
+     * @brief Sleep until there is work: a measurement, a key event or the next LVGL timer
+     *
+     * @param idle The time to the next LVGL timer in ms, as returned by lv_timer_handler()
+     */
+    static void sleepUntilWork(const uint32_t idle)
+    {
+        auto timeout = std::min<uint32_t>(idle, STATS_PERIOD);
+        auto start = time_us_64();
+        auto deadline = start + timeout * 1000ull;
+
+        // The alarm fires right away if the deadline has passed
+        if (hardware_alarm_set_target(alarmNum, from_us_since_boot(deadline)))
+            return;
+
+        while (!keyChanged && !measurements.size() && time_us_64() < deadline)
+            __wfe();
+        sleepTime += time_us_64() - start;
+    }
+
+    /**
+     * @brief Print a value in chart units, i.e. milli-units, with 2 decimals of the base unit
+     */
+    static int printTrendValue(char *buf, const std::size_t len, const int32_t value)
+    {
+        auto hundredths = static_cast<uint32_t>((value < 0 ? -value : value) + 5) / 10;
+        return snprintf(buf, len, "%s%u.%02u", value < 0 && hundredths ? "-" : "",
+                        static_cast<unsigned>(hundredths / 100), static_cast<unsigned>(hundredths % 100));
+    }
+
+    /**
+     * @brief Redraw the chart from the buckets of the level, if a bucket was closed since the last time
+     *
+     * The chart has a point per bucket, so the cost doesn't depend on the time the level covers.
+     */
+    static void refreshTrend()
+    {
+        if (lv_tileview_get_tile_active(tileview) != trendTile)
+            return;
+
+        auto revision = History::getRevision(trendLevel);
+        if (revision == trendRevision)
+            return;
+        trendRevision = revision;
+
+        static History::Bucket buckets[HISTORY_LENGTH];
+        constexpr const char *LEVEL_NAMES[History::LEVEL_COUNT]{"1 s", "1 min", "1 h"};
+        constexpr char UNITS[History::CHANNEL_COUNT]{'V', 'A'};
+        char text[64];
+        int len = snprintf(text, sizeof(text), "%s per point", LEVEL_NAMES[trendLevel]);
+        for (uint8_t c = 0; c < History::CHANNEL_COUNT; c++)
+        {
+            auto count = History::read(trendLevel, static_cast<History::Channel>(c), buckets);
+            int32_t *points[3];
+            for (uint8_t s = 0; s < 3; s++)
+                points[s] = lv_chart_get_y_array(trendChart, trendSeries[c][s]);
+
+            // The newest bucket on the right, the slots without a bucket yet are left empty
+            int32_t lo = INT32_MAX;
+            int32_t hi = INT32_MIN;
+            auto offset = HISTORY_LENGTH - count;
+            for (uint16_t i = 0; i < HISTORY_LENGTH; i++)
+            {
+                if (i < offset || buckets[i - offset].mean == FixedPoint::INVALID)
+                {
+                    for (auto p : points)
+                        p[i] = LV_CHART_POINT_NONE;
+                    continue;
+                }
+                auto &b = buckets[i - offset];
+                points[0][i] = b.min / TREND_UNIT;
+                points[1][i] = b.mean / TREND_UNIT;
+                points[2][i] = b.max / TREND_UNIT;
+                lo = std::min(lo, points[0][i]);
+                hi = std::max(hi, points[2][i]);
+            }
+
+            if (lo > hi) // Nothing to show
+            {
+                lo = 0;
+                hi = TREND_UNIT;
+            }
+            auto margin = std::max<int32_t>((hi - lo) / 20, 1);
+            lv_chart_set_range(trendChart, c == History::VOLTAGE ? LV_CHART_AXIS_PRIMARY_Y : LV_CHART_AXIS_SECONDARY_Y,
+                               lo - margin, hi + margin);
+
+            len += snprintf(text + len, sizeof(text) - len, "\n%c: ", UNITS[c]);
+            len += printTrendValue(text + len, sizeof(text) - len, lo);
+            len += snprintf(text + len, sizeof(text) - len, " - ");
+            len += printTrendValue(text + len, sizeof(text) - len, hi);
+        }
+
+        lv_label_set_text(trendLabel, text);
+        lv_chart_refresh(trendChart);
+    }
+
+    /**
+     * @brief Show the next history level, when the chart is clicked with the ENTER key
+     */
+    static void onTrendClicked(lv_event_t *ev)
+    {
+        trendLevel = static_cast<History::Level>((trendLevel + 1) % History::LEVEL_COUNT);
+        trendRevision = UINT32_MAX;
+    }
+
+    /**
+     * @brief Scroll to the page of the focused object, so NEXT and PREV also move between the pages
+     */
+    static void onPageObjectFocused(lv_event_t *ev)
+    {
+        auto tile = static_cast<lv_obj_t *>(lv_event_get_user_data(ev));
+        lv_tileview_set_tile(tileview, tile, LV_ANIM_ON);
+        trendRevision = UINT32_MAX;
     }
 
     inline void readKey(lv_indev_t *indev, lv_indev_data_t *data)
@@ -45,9 +304,16 @@ namespace Display
             ULOG_WARNING("readKeyEventCb not set");
             return;
         }
-        auto [key, pressed] = readKeyEventCb();
-        data->key = key;
-        data->state = pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+
+        // The long presses and the repeats are held key inputs, which LVGL turns into its own events
+        KeyInput input;
+        if (readKeyEventCb(input))
+            lastKey = input;
+        else
+            lastKey.more = false;
+        data->key = lastKey.key;
+        data->state = lastKey.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+        data->continue_reading = lastKey.more;
     }
 
     void setReadKeyEventCb(ReadKeyEventCallback cb)
@@ -61,7 +327,7 @@ namespace Display
             ULOG_TRACE_LEVEL, ULOG_INFO_LEVEL, ULOG_WARNING_LEVEL,
             ULOG_ERROR_LEVEL, ULOG_ALWAYS_LEVEL, static_cast<ulog_level_t>(0)};
 
-        ulog_message(ULOG_LEVELS[level], buf);
+        Log::write(ULOG_LEVELS[level], "%s", buf);
     }
 
     inline void toggleTheme(lv_event_t *ev)
@@ -83,25 +349,46 @@ namespace Display
         screen.begin();
         screen.setSwapBytes(true);
         screen.initDMA();
+        screen.startWrite();
+
+        // flush_ready comes from the interrupt of the TFT_eSPI DMA channel, on this core
+        dma_channel_set_irq0_enabled(dma_tx_channel, true);
+        irq_add_shared_handler(DMA_IRQ_0, onFlushComplete, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+
+        alarmNum = hardware_alarm_claim_unused(true);
+        hardware_alarm_set_callback(alarmNum, onAlarm); // The interrupt is on this core
 
         lv_init();
         lv_tick_set_cb(millis);
 
         lv_log_register_print_cb(printLog);
 
-        static uint32_t drawBuf[TFT_WIDTH * TFT_HEIGHT / 10];
-        auto disp = lv_display_create(TFT_WIDTH, TFT_HEIGHT);
-        lv_display_set_flush_cb(disp, flushDisplay);
-        lv_display_set_buffers(disp, drawBuf, NULL, sizeof(drawBuf),
+        // Two buffers of 1/10 screen in RGB565, one is rendered while the other is transferred
+        static uint16_t drawBufs[2][TFT_WIDTH * TFT_HEIGHT / 10];
+        display = lv_display_create(TFT_WIDTH, TFT_HEIGHT);
+        lv_display_set_flush_cb(display, flushDisplay);
+        lv_display_set_flush_wait_cb(display, waitFlush);
+        lv_display_set_buffers(display, drawBufs[0], drawBufs[1], sizeof(drawBufs[0]),
                                LV_DISPLAY_RENDER_MODE_PARTIAL);
+        lv_display_add_event_cb(display, onRefreshEvent, LV_EVENT_REFR_START, nullptr);
+        lv_display_add_event_cb(display, onRefreshEvent, LV_EVENT_REFR_READY, nullptr);
 
-        auto keyPadIndev = lv_indev_create();
+        // The keys are read when events are queued, instead of by the polling timer of LVGL
+        keyPadIndev = lv_indev_create();
         lv_indev_set_type(keyPadIndev, LV_INDEV_TYPE_KEYPAD);
         lv_indev_set_read_cb(keyPadIndev, readKey);
+        lv_indev_set_mode(keyPadIndev, LV_INDEV_MODE_EVENT);
+
+        // Pages side by side, the readouts and the trend chart
+        tileview = lv_tileview_create(lv_screen_active());
+        lv_obj_set_scrollbar_mode(tileview, LV_SCROLLBAR_MODE_OFF);
+        readoutTile = lv_tileview_add_tile(tileview, 0, 0, LV_DIR_RIGHT);
+        trendTile = lv_tileview_add_tile(tileview, 1, 0, LV_DIR_LEFT);
 
-        // Put the widgets on the screen
-        auto vHintLabel = lv_label_create(lv_screen_active());
-        auto iHintLabel = lv_label_create(lv_screen_active());
+        // Put the widgets on the readout page
+        auto vHintLabel = lv_label_create(readoutTile);
+        auto iHintLabel = lv_label_create(readoutTile);
         lv_obj_align(vHintLabel, LV_ALIGN_LEFT_MID, 8, -80);
         lv_obj_align(iHintLabel, LV_ALIGN_LEFT_MID, 8, 40);
         lv_label_set_text(vHintLabel, "Voltage: ");
@@ -109,70 +396,129 @@ namespace Display
         lv_obj_set_style_text_font(vHintLabel, &lv_font_montserrat_24, LV_PART_MAIN);
         lv_obj_set_style_text_font(iHintLabel, &lv_font_montserrat_24, LV_PART_MAIN);
 
-        vValueLabel = lv_label_create(lv_screen_active());
-        iValueLabel = lv_label_create(lv_screen_active());
-        lv_obj_align(vValueLabel, LV_ALIGN_RIGHT_MID, -8, -80);
-        lv_obj_align(iValueLabel, LV_ALIGN_RIGHT_MID, -8, 40);
-        lv_obj_set_style_text_font(vValueLabel, &lv_font_montserrat_24, LV_PART_MAIN);
-        lv_obj_set_style_text_font(iValueLabel, &lv_font_montserrat_24, LV_PART_MAIN);
-        lv_label_set_text(vValueLabel, "---");
-        lv_label_set_text(iValueLabel, "---");
+        // Readouts redrawn per character cell, so a reading only sends the digits that changed
+        vReadout.create(readoutTile, &lv_font_montserrat_24, READOUT_CELLS);
+        iReadout.create(readoutTile, &lv_font_montserrat_24, READOUT_CELLS);
+        lv_obj_align(vReadout.getObj(), LV_ALIGN_RIGHT_MID, -8, -80);
+        lv_obj_align(iReadout.getObj(), LV_ALIGN_RIGHT_MID, -8, 40);
+        vReadout.setText("---");
+        iReadout.setText("---");
 
         auto buttonGroup = lv_group_create();
         lv_indev_set_group(keyPadIndev, buttonGroup);
 
-        auto lightDarkButton = lv_imagebutton_create(lv_screen_active());
+        auto lightDarkButton = lv_imagebutton_create(readoutTile);
         lv_obj_set_size(lightDarkButton, 50, 50);
         lv_obj_align(lightDarkButton, LV_ALIGN_BOTTOM_MID, 0, -8);
         lv_imagebutton_set_src(lightDarkButton, LV_IMAGEBUTTON_STATE_RELEASED, nullptr, &darkLogo, nullptr);
         lv_group_add_obj(buttonGroup, lightDarkButton);
         lv_obj_add_event_cb(lightDarkButton, toggleTheme, LV_EVENT_CLICKED, nullptr);
+        lv_obj_add_event_cb(lightDarkButton, onPageObjectFocused, LV_EVENT_FOCUSED, readoutTile);
+
+        // The trend page, min, mean and max of each bucket, the voltage on the left axis
+        trendLabel = lv_label_create(trendTile);
+        lv_obj_align(trendLabel, LV_ALIGN_TOP_MID, 0, 4);
+        lv_obj_set_style_text_align(trendLabel, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
+        lv_label_set_text(trendLabel, "");
+
+        trendChart = lv_chart_create(trendTile);
+        lv_obj_set_size(trendChart, TFT_WIDTH, TFT_HEIGHT - 64); // Below the 3 lines of the label
+        lv_obj_align(trendChart, LV_ALIGN_BOTTOM_MID, 0, 0);
+        lv_chart_set_type(trendChart, LV_CHART_TYPE_LINE);
+        lv_chart_set_point_count(trendChart, HISTORY_LENGTH);
+        lv_chart_set_div_line_count(trendChart, 5, 6);
+        lv_obj_set_style_size(trendChart, 0, 0, LV_PART_INDICATOR); // No dots on the points
+        lv_obj_set_style_line_width(trendChart, 1, LV_PART_ITEMS);
+        const lv_palette_t palettes[History::CHANNEL_COUNT]{LV_PALETTE_BLUE, LV_PALETTE_RED};
+        for (uint8_t c = 0; c < History::CHANNEL_COUNT; c++)
+        {
+            auto axis = c == History::VOLTAGE ? LV_CHART_AXIS_PRIMARY_Y : LV_CHART_AXIS_SECONDARY_Y;
+            trendSeries[c][0] = lv_chart_add_series(trendChart, lv_palette_lighten(palettes[c], 3), axis);
+            trendSeries[c][1] = lv_chart_add_series(trendChart, lv_palette_main(palettes[c]), axis);
+            trendSeries[c][2] = lv_chart_add_series(trendChart, lv_palette_lighten(palettes[c], 3), axis);
+        }
+        lv_group_add_obj(buttonGroup, trendChart);
+        lv_obj_add_event_cb(trendChart, onPageObjectFocused, LV_EVENT_FOCUSED, trendTile);
+        lv_obj_add_event_cb(trendChart, onTrendClicked, LV_EVENT_CLICKED, nullptr);
     }
 
-    void updateVoltage(const float value)
+    void pushMeasurement(const Measurement &m)
     {
-        voltageValue = value;
-        voltageUpdated = true;
+        measurements.push(m);
+
+        // The element must be visible before core 1 wakes up and looks
+        __dsb();
+        __sev();
     }
 
-    void updateCurrent(const float value)
+    void notifyKeyEvent()
     {
-        currentValue = value;
-        currentUpdated = true;
+        keyChanged = true;
+        __sev();
     }
 
-    inline void updateText(lv_obj_t *label, const float value, const char unit)
+    void setConsumeMode(const ConsumeMode mode)
     {
-        if (!label)
-        {
-            ULOG_ERROR("Cannot update text: target label is NULL");
-            return;
-        }
-        String txt;
-        if (value == -1)
-            txt = "----";
-        else if (value == INFINITY)
-            txt = "Overload";
-        else
-            txt = String(value, 2) + " " + unit;
+        consumeMode.store(mode, std::memory_order_relaxed);
+    }
+
+    uint32_t getQueueOverflows()
+    {
+        return measurements.getOverflows();
+    }
 
-        lv_label_set_text(label, txt.c_str());
+    uint32_t getSkippedMeasurements()
+    {
+        return skippedMeasurements;
+    }
+
+    FrameStats getFrameStats()
+    {
+        return {frameStats.fps10, frameStats.avgFlushUs, frameStats.maxFlushUs, frameStats.waitPermille,
+                frameStats.sleepPermille};
+    }
+
+    /**
+     * @brief Show a measurement
+     */
+    static void showMeasurement(const Measurement &m)
+    {
+        vReadout.setValue(m.voltage, 'V');
+        iReadout.setValue(m.current, 'A');
     }
 
     void run()
     {
-        if (voltageUpdated)
+        if (keyChanged)
         {
-            updateText(vValueLabel, voltageValue, 'V');
-            voltageUpdated = false;
+            keyChanged = false; // Before reading, so a change meanwhile isn't lost
+            lv_indev_read(keyPadIndev); // Drains the queue, see readKey()
         }
 
-        if (currentUpdated)
+        // Every measurement goes to the history, the consume mode only applies to the readouts
+        Measurement m;
+        uint32_t taken = 0;
+        auto latest = consumeMode.load(std::memory_order_relaxed) == ConsumeMode::LATEST;
+        while (measurements.pop(m))
+        {
+            History::push(m.timestamp, m.voltage, m.current);
+            if (!latest)
+                showMeasurement(m);
+            taken++;
+        }
+        if (latest && taken)
         {
-            updateText(iValueLabel, currentValue, 'A');
-            currentUpdated = false;
+            skippedMeasurements += taken - 1;
+            showMeasurement(m);
         }
+        refreshTrend();
 
-        delay(lv_timer_handler());
+        uint32_t idle;
+        {
+            PERF_SCOPE(LVGL_TIMER);
+            idle = lv_timer_handler();
+        }
+        updateFrameStats();
+        sleepUntilWork(idle);
     }
 } // namespace display
@@ -0,0 +1,165 @@
+#include <Arduino.h>
+#include <algorithm>
+#include <cstdarg>
+#include <hardware/flash.h>
+#include <hardware/gpio.h>
+#include <hardware/sync.h>
+#include <pico/platform.h>
+#include <pico/time.h>
+
+#include "Hal.h"
+
+// The flash areas of the linker script of the Arduino core, the settings take the one of the file system
+extern "C" uint8_t _FS_start, _FS_end, _EEPROM_start;
+
+namespace Hal
+{
+    void pinOutput(const uint32_t pin)
+    {
+        pinMode(pin, OUTPUT);
+    }
+
+    void pinInput(const uint32_t pin, const bool pullUp)
+    {
+        pinMode(pin, pullUp ? INPUT_PULLUP : INPUT);
+    }
+
+    bool pinRead(const uint32_t pin)
+    {
+        return digitalRead(pin);
+    }
+
+    void pinsPut(const uint32_t mask, const uint32_t value)
+    {
+        gpio_put_masked(mask, value);
+    }
+
+    uint32_t millis()
+    {
+        return ::millis();
+    }
+
+    uint32_t micros()
+    {
+        return ::micros();
+    }
+
+    struct Timer
+    {
+        repeating_timer_t timer;
+        TimerCb cb;
+        void *param;
+    };
+
+    static Timer timers[2];
+    static uint8_t timerCount = 0;
+
+    static bool onTimer(repeating_timer_t *rt)
+    {
+        auto timer = static_cast<Timer *>(rt->user_data);
+        timer->cb(timer->param);
+        return true;
+    }
+
+    bool startTimer(const uint32_t periodUs, TimerCb cb, void *param)
+    {
+        if (timerCount == std::size(timers))
+            return false;
+
+        // In the default alarm pool, whose interrupt is on core 0, negative for a period between the starts
+        auto &timer = timers[timerCount++];
+        timer.cb = cb;
+        timer.param = param;
+        return add_repeating_timer_us(-static_cast<int64_t>(periodUs), onTimer, &timer, &timer.timer);
+    }
+
+    uint8_t coreNum()
+    {
+        return get_core_num();
+    }
+
+    uint32_t interruptsOff()
+    {
+        return save_and_disable_interrupts();
+    }
+
+    void interruptsRestore(const uint32_t state)
+    {
+        restore_interrupts(state);
+    }
+
+    void serialBegin(const uint32_t baudRate)
+    {
+        Serial.setTimeout(20);
+        Serial.begin(baudRate);
+    }
+
+    int serialRead()
+    {
+        return Serial.available() ? Serial.read() : -1;
+    }
+
+    std::size_t serialAvailableForWrite()
+    {
+        return Serial.availableForWrite();
+    }
+
+    void serialWrite(const char *data, const std::size_t len)
+    {
+        Serial.write(data, len);
+    }
+
+    void serialWrite(const char *str)
+    {
+        Serial.print(str);
+    }
+
+    void serialPrintf(const char *fmt, ...)
+    {
+        char buf[256];
+        va_list args;
+        va_start(args, fmt);
+        auto len = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (len > 0)
+            Serial.write(buf, std::min<std::size_t>(len, sizeof(buf) - 1));
+    }
+
+    /**
+     * @brief Run a flash operation with the other core paused, since the flash can't be read meanwhile
+     */
+    template <typename Fn>
+    static void runFlashOperation(Fn &&fn)
+    {
+        rp2040.idleOtherCore();
+        auto state = save_and_disable_interrupts();
+        fn();
+        restore_interrupts(state);
+        rp2040.resumeOtherCore();
+    }
+
+    std::span<const uint8_t> storageArea()
+    {
+        return {&_FS_start, &_FS_end};
+    }
+
+    void storageErase(const std::size_t sector)
+    {
+        auto offset = reinterpret_cast<uintptr_t>(&_FS_start) - XIP_BASE + sector * STORAGE_SECTOR_SIZE;
+        runFlashOperation([offset]
+                          { flash_range_erase(offset, STORAGE_SECTOR_SIZE); });
+    }
+
+    void storageProgram(const std::size_t page, const uint8_t *data)
+    {
+        auto offset = reinterpret_cast<uintptr_t>(&_FS_start) - XIP_BASE + page * STORAGE_PAGE_SIZE;
+        runFlashOperation([offset, data]
+                          { flash_range_program(offset, data, STORAGE_PAGE_SIZE); });
+    }
+
+    std::span<const uint8_t> legacyStorageArea()
+    {
+        return {&_EEPROM_start, STORAGE_SECTOR_SIZE};
+    }
+
+} // namespace Hal
@@ -0,0 +1,146 @@
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <pico/platform.h>
+
+#include "Console.h"
+#include "HeapGuard.h"
+#include "config.h"
+#include "Log.h"
+
+extern "C"
+{
+    extern const char help_heap[];
+}
+
+namespace HeapGuard
+{
+    static volatile bool coreDone[2]; // Written only by the core of each entry
+    static volatile bool armed = false;
+
+    // Written only by the core of each entry
+    static volatile uint32_t allocations[2];
+    static volatile uint32_t lastSize[2];
+
+    static uint32_t baseline = 0; // C heap in use when armed
+    static uint32_t reported = 0; // Highest usage warned about
+
+    static void cmdHeapCallback(Console::Args args)
+    {
+        auto info = mallinfo();
+        ULOG_INFO("Heap in use: %u bytes, %u when armed, free: %u bytes",
+                  static_cast<unsigned>(info.uordblks), static_cast<unsigned>(baseline),
+                  static_cast<unsigned>(info.fordblks));
+        for (uint8_t core = 0; core < 2; core++)
+            ULOG_INFO("Core %u: %u allocations after the setup, last %u bytes", core,
+                      static_cast<unsigned>(allocations[core]), static_cast<unsigned>(lastSize[core]));
+        if (!armed)
+            ULOG_INFO("Not armed, the setup of a core is not done");
+    }
+
+    void init()
+    {
+        Console::Command heapCmd{"heap", help_heap, 0, 0, cmdHeapCallback};
+        Console::registerCommand(heapCmd);
+    }
+
+    void setupDone()
+    {
+        // Each core writes only its own flag, so the last one to finish sees both set.
+        // If they finish together both may arm, with the same baseline then.
+        coreDone[get_core_num()] = true;
+        if (coreDone[0] && coreDone[1])
+        {
+            baseline = mallinfo().uordblks;
+            reported = baseline;
+            armed = true;
+        }
+    }
+
+    void check()
+    {
+        if (!armed)
+            return;
+
+        uint32_t used = mallinfo().uordblks;
+        if (used > reported)
+        {
+            ULOG_WARNING("Heap grew to %u bytes since the setup, from %u", static_cast<unsigned>(used),
+                         static_cast<unsigned>(baseline));
+            reported = used;
+        }
+    }
+
+    /**
+     * @brief Count an allocation, called from the allocation operators
+     */
+    static inline void onAllocation(const std::size_t size)
+    {
+        if (!armed)
+            return;
+
+        if constexpr (HEAP_GUARD_PANIC)
+            panic("Heap allocation of %u bytes after the setup", static_cast<unsigned>(size));
+
+        auto core = get_core_num();
+        allocations[core] = allocations[core] + 1;
+        lastSize[core] = size;
+    }
+
+} // namespace HeapGuard
+
+// The replaceable allocation operators, all of them so the ones of the core are not linked
+
+void *operator new(std::size_t size)
+{
+    HeapGuard::onAllocation(size);
+    return malloc(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    HeapGuard::onAllocation(size);
+    return malloc(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    HeapGuard::onAllocation(size);
+    return malloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    HeapGuard::onAllocation(size);
+    return malloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    free(ptr);
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <limits>
+
+#include "FixedPoint.hpp"
+#include "History.h"
+#include "config.h"
+
+namespace History
+{
+    constexpr uint32_t BUCKET_US = 1000000;
+    constexpr uint8_t BUCKETS_PER_PARENT = 60; // Buckets of a level closing one of the next level
+
+    /** A bucket being filled, the mean is kept as a sum so the levels above weigh it by its count */
+    struct Accumulator
+    {
+        int32_t min;
+        int32_t max;
+        int64_t sum;
+        uint32_t count;
+
+        inline void clear()
+        {
+            min = std::numeric_limits<int32_t>::max();
+            max = std::numeric_limits<int32_t>::min();
+            sum = 0;
+            count = 0;
+        }
+
+        inline void add(const int32_t value)
+        {
+            if (value == FixedPoint::INVALID || value == FixedPoint::OVERLOAD)
+                return;
+            min = std::min(min, value);
+            max = std::max(max, value);
+            sum += value;
+            count++;
+        }
+
+        inline void add(const Accumulator &a)
+        {
+            min = std::min(min, a.min);
+            max = std::max(max, a.max);
+            sum += a.sum;
+            count += a.count;
+        }
+
+        inline Bucket toBucket() const
+        {
+            if (!count)
+                return {FixedPoint::INVALID, FixedPoint::INVALID, FixedPoint::INVALID};
+            return {min, max, static_cast<int32_t>(sum / count)};
+        }
+    };
+
+    struct LevelState
+    {
+        Bucket buckets[CHANNEL_COUNT][HISTORY_LENGTH];
+        uint16_t next = 0; // Slot of the next bucket
+        uint16_t count = 0;
+        uint8_t children = 0; // Buckets of the level below in the open bucket
+        uint32_t revision = 0;
+        Accumulator open[CHANNEL_COUNT];
+    };
+
+    static LevelState levels[LEVEL_COUNT];
+    static bool started = false;
+    static uint32_t bucketStart; // Start of the open second bucket
+
+    /**
+     * @brief Close the open bucket of a level, and fold it into the level above
+     */
+    static void close(const uint8_t level)
+    {
+        auto &l = levels[level];
+        for (uint8_t c = 0; c < CHANNEL_COUNT; c++)
+        {
+            l.buckets[c][l.next] = l.open[c].toBucket();
+            if (level + 1 < LEVEL_COUNT)
+                levels[level + 1].open[c].add(l.open[c]);
+            l.open[c].clear();
+        }
+        l.next = (l.next + 1) % HISTORY_LENGTH;
+        l.count = std::min<uint16_t>(l.count + 1, HISTORY_LENGTH);
+        l.revision++;
+
+        if (level + 1 < LEVEL_COUNT && ++levels[level + 1].children == BUCKETS_PER_PARENT)
+        {
+            close(level + 1);
+            levels[level + 1].children = 0;
+        }
+    }
+
+    void push(const uint32_t timestamp, const int32_t voltage, const int32_t current)
+    {
+        if (!started)
+        {
+            for (auto &l : levels)
+                for (auto &a : l.open)
+                    a.clear();
+            bucketStart = timestamp;
+            started = true;
+        }
+
+        // A gap longer than a bucket closes the empty buckets in between, so the time axis stays even
+        while (timestamp - bucketStart >= BUCKET_US)
+        {
+            close(SECONDS);
+            bucketStart += BUCKET_US;
+        }
+
+        levels[SECONDS].open[VOLTAGE].add(voltage);
+        levels[SECONDS].open[CURRENT].add(current);
+    }
+
+    uint16_t read(const Level level, const Channel channel, std::span<Bucket> out)
+    {
+        auto &l = levels[level];
+        auto count = std::min<std::size_t>(l.count, out.size());
+        auto first = (l.next + HISTORY_LENGTH - count) % HISTORY_LENGTH;
+        for (std::size_t i = 0; i < count; i++)
+            out[i] = l.buckets[channel][(first + i) % HISTORY_LENGTH];
+        return count;
+    }
+
+    uint32_t getRevision(const Level level)
+    {
+        return levels[level].revision;
+    }
+
+} // namespace History
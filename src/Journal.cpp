@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstring>
+
+#include "Crc16.hpp"
+#include "Hal.h"
+#include "Journal.h"
+#include "Log.h"
+
+namespace Journal
+{
+    constexpr uint32_t RECORD_MAGIC = 0x4C4E524A; // "JRNL"
+    constexpr std::size_t PAGE_SIZE = Hal::STORAGE_PAGE_SIZE;
+    constexpr std::size_t SECTOR_PAGES = Hal::STORAGE_SECTOR_SIZE / PAGE_SIZE;
+    constexpr std::size_t NO_PAGE = SIZE_MAX;
+
+    struct RecordHeader
+    {
+        uint32_t magic;    // Should be RECORD_MAGIC
+        uint32_t sequence; // Increasing, the latest record has the highest
+        uint16_t version;
+        uint16_t length; // Of the payload after the header
+        uint16_t crc;    // Of the header before it and the payload
+        uint16_t reserved;
+    };
+
+    static std::size_t pageCount = 0;
+    static std::size_t latestPage = NO_PAGE;
+    static uint32_t latestSequence = 0;
+    static std::size_t nextPage = 0; // The records are appended from here
+    static Hook beforeErase = nullptr;
+    static Hook afterErase = nullptr;
+
+    static inline const uint8_t *getPage(const std::size_t page)
+    {
+        return Hal::storageArea().data() + page * PAGE_SIZE;
+    }
+
+    static inline std::size_t getRecordPages(const std::size_t len)
+    {
+        return (sizeof(RecordHeader) + len + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
+
+    static uint16_t getCrc(const RecordHeader &header, const uint8_t *payload)
+    {
+        auto crc = crc16({reinterpret_cast<const uint8_t *>(&header), offsetof(RecordHeader, crc)});
+        return crc16({payload, header.length}, crc);
+    }
+
+    static bool isErased(const std::size_t page, const std::size_t count)
+    {
+        auto p = getPage(page);
+        return std::all_of(p, p + count * PAGE_SIZE, [](uint8_t b)
+                           { return b == 0xFF; });
+    }
+
+    /**
+     * @brief Read the header of a complete record
+     *
+     * @return false if there is no complete record at the page
+     */
+    static bool readRecord(const std::size_t page, RecordHeader &header)
+    {
+        memcpy(&header, getPage(page), sizeof(header));
+        return header.magic == RECORD_MAGIC &&
+               getRecordPages(header.length) <= SECTOR_PAGES - page % SECTOR_PAGES &&
+               header.crc == getCrc(header, getPage(page) + sizeof(header));
+    }
+
+    void setEraseHooks(Hook before, Hook after)
+    {
+        beforeErase = before;
+        afterErase = after;
+    }
+
+    bool init()
+    {
+        pageCount = Hal::storageArea().size() / Hal::STORAGE_SECTOR_SIZE * SECTOR_PAGES;
+        if (pageCount < 2 * SECTOR_PAGES)
+        {
+            ULOG_ERROR("Settings storage too small: %u bytes, 2 sectors at least",
+                       static_cast<unsigned>(Hal::storageArea().size()));
+            pageCount = 0;
+            return false;
+        }
+
+        latestPage = NO_PAGE;
+        RecordHeader header;
+        for (std::size_t page = 0; page < pageCount;)
+        {
+            if (!readRecord(page, header))
+            {
+                page++;
+                continue;
+            }
+
+            if (latestPage == NO_PAGE || static_cast<int32_t>(header.sequence - latestSequence) > 0)
+            {
+                latestPage = page;
+                latestSequence = header.sequence;
+                nextPage = page + getRecordPages(header.length);
+            }
+            page += getRecordPages(header.length);
+        }
+        return true;
+    }
+
+    std::size_t readLatest(uint16_t &version, void *data, const std::size_t maxLen)
+    {
+        RecordHeader header;
+        if (latestPage == NO_PAGE || !readRecord(latestPage, header))
+            return 0;
+
+        version = header.version;
+        memcpy(data, getPage(latestPage) + sizeof(header), std::min<std::size_t>(header.length, maxLen));
+        return header.length;
+    }
+
+    bool append(const uint16_t version, const void *data, const std::size_t len, CommitStats &stats)
+    {
+        auto start = Hal::micros();
+        stats = {};
+        auto pages = getRecordPages(len);
+        if (!pageCount || pages > SECTOR_PAGES)
+        {
+            ULOG_ERROR("Unable to commit %u bytes: %s", static_cast<unsigned>(len), pageCount ? "too large" : "no storage");
+            return false;
+        }
+
+        // The first erased pages after the latest record, skipping the remains of an interrupted commit,
+        // in the same sector or the next one, whose older records are erased then
+        std::size_t page = 0;
+        std::size_t sectorEnd = SECTOR_PAGES;
+        if (latestPage != NO_PAGE)
+        {
+            page = nextPage;
+            sectorEnd = (latestPage / SECTOR_PAGES + 1) * SECTOR_PAGES;
+        }
+        while (page + pages <= sectorEnd && !isErased(page, pages))
+            page++;
+        if (page + pages > sectorEnd)
+        {
+            page = sectorEnd % pageCount;
+            if (!isErased(page, SECTOR_PAGES))
+            {
+                if (beforeErase)
+                    beforeErase();
+                auto t = Hal::micros();
+                Hal::storageErase(page / SECTOR_PAGES);
+                stats.maxLockoutUs = Hal::micros() - t;
+                stats.erased = true;
+                if (afterErase)
+                    afterErase();
+            }
+        }
+
+        RecordHeader header{RECORD_MAGIC, latestSequence + 1, version, static_cast<uint16_t>(len), 0, 0xFFFF};
+        header.crc = getCrc(header, static_cast<const uint8_t *>(data));
+
+        // The first page holds the header, so the record is complete only once it's programmed
+        for (auto i = pages; i-- > 0;)
+        {
+            // In RAM, the flash can't be read while programming
+            static uint8_t buf[PAGE_SIZE];
+            memset(buf, 0xFF, sizeof(buf));
+            std::size_t pos = i * PAGE_SIZE; // In the record
+            std::size_t end = std::min(pos + PAGE_SIZE, sizeof(header) + len);
+            for (auto p = buf; pos < end; pos++, p++)
+                *p = pos < sizeof(header) ? reinterpret_cast<const uint8_t *>(&header)[pos]
+                                          : static_cast<const uint8_t *>(data)[pos - sizeof(header)];
+
+            auto t = Hal::micros();
+            Hal::storageProgram(page + i, buf);
+            stats.maxLockoutUs = std::max(stats.maxLockoutUs, Hal::micros() - t);
+        }
+
+        nextPage = page + pages;
+        stats.pages = pages;
+        stats.totalUs = Hal::micros() - start;
+        if (!readRecord(page, header))
+        {
+            ULOG_ERROR("Unable to commit: the record at page %u doesn't read back", static_cast<unsigned>(page));
+            return false;
+        }
+
+        latestPage = page;
+        latestSequence = header.sequence;
+        return true;
+    }
+
+} // namespace Journal
@@ -0,0 +1,112 @@
+#include <algorithm>
+
+#include "Hal.h"
+#include "Log.h"
+#include "SpscRing.hpp"
+
+namespace Log
+{
+    // One ring per core, so each has a single producer; the consumer is drain() on core 0
+    static SpscRing<Record, LOG_QUEUE_LENGTH> rings[2];
+    static uint32_t reportedOverflows[2];
+    static bool muted = false;
+
+    // A formatted line waiting for room in the serial port
+    static char line[LOG_LINE_LENGTH];
+    static std::size_t lineLen = 0;
+
+    void enqueue(Record &record)
+    {
+        record.timestamp = Hal::millis();
+
+        // Interrupts of the same core are producers too
+        auto state = Hal::interruptsOff();
+        rings[Hal::coreNum()].push(record);
+        Hal::interruptsRestore(state);
+    }
+
+    void setMuted(const bool m)
+    {
+        muted = m;
+    }
+
+    /**
+     * @brief Format the record into the line, with the timestamp and the level
+     */
+    static void formatLine(const Record &r)
+    {
+        auto len = snprintf(line, sizeof(line), "[%u] %s: ", static_cast<unsigned>(r.timestamp),
+                            ulog_level_name(static_cast<ulog_level_t>(r.level)));
+        len += r.formatter(line + len, sizeof(line) - len, r.fmt, r.args);
+        len = std::min<std::size_t>(len, sizeof(line) - 1);
+        len += snprintf(line + len, sizeof(line) - len, "%s\r\n", r.truncated ? "..." : "");
+        lineLen = std::min<std::size_t>(len, sizeof(line) - 1);
+
+        // The end of line is kept even if the message was cut
+        if (lineLen == sizeof(line) - 1)
+        {
+            line[lineLen - 2] = '\r';
+            line[lineLen - 1] = '\n';
+        }
+    }
+
+    /**
+     * @brief Prepare the next line, the oldest record of both cores, or the notice of dropped records
+     *
+     * @return false if there is nothing to write
+     */
+    static bool nextLine()
+    {
+        for (uint8_t core = 0; core < 2; core++)
+        {
+            auto overflows = rings[core].getOverflows();
+            if (overflows != reportedOverflows[core])
+            {
+                lineLen = snprintf(line, sizeof(line), "[%u] %s: %u log records of core %u dropped\r\n",
+                                   static_cast<unsigned>(Hal::millis()), ulog_level_name(ULOG_WARNING_LEVEL),
+                                   static_cast<unsigned>(overflows - reportedOverflows[core]), core);
+                reportedOverflows[core] = overflows;
+                return true;
+            }
+        }
+
+        auto r0 = rings[0].peek();
+        auto r1 = rings[1].peek();
+        if (!r0 && !r1)
+            return false;
+
+        Record r;
+        rings[r0 && (!r1 || static_cast<int32_t>(r1->timestamp - r0->timestamp) >= 0) ? 0 : 1].pop(r);
+        formatLine(r);
+        return true;
+    }
+
+    void drain()
+    {
+        while (true)
+        {
+            if (lineLen)
+            {
+                if (!muted && Hal::serialAvailableForWrite() < lineLen)
+                    return; // Later, the records wait in the rings meanwhile
+                if (!muted)
+                    Hal::serialWrite(line, lineLen);
+                lineLen = 0;
+            }
+
+            if (!nextLine())
+                return;
+        }
+    }
+
+    void flush()
+    {
+        do
+        {
+            if (lineLen && !muted)
+                Hal::serialWrite(line, lineLen);
+            lineLen = 0;
+        } while (nextLine());
+    }
+
+} // namespace Log
@@ -0,0 +1,132 @@
+#ifdef PERF_ENABLED
+
+#include <Arduino.h>
+#include <algorithm>
+#include <bit>
+#include <hardware/timer.h>
+#include <pico/platform.h>
+
+#include "Console.h"
+#include "Hal.h"
+#include "Log.h"
+#include "Perf.h"
+
+extern "C"
+{
+    extern const char help_perf[];
+}
+
+namespace Perf
+{
+    constexpr const char *PROBE_NAMES[PROBE_COUNT]{
+        "sample", "range", "value", "log", "console", "lv_timer", "lv_render", "lv_flush"};
+
+    struct Stats
+    {
+        uint32_t count;
+        uint32_t min;
+        uint32_t max;
+        uint64_t total;
+        uint32_t hist[HIST_BUCKETS];
+    };
+
+    // Written only by the core of each row
+    static Stats stats[2][PROBE_COUNT];
+    static volatile bool resetRequested[2];
+
+    static void clearStats(const uint8_t core)
+    {
+        for (auto &s : stats[core])
+            s = {};
+    }
+
+    uint32_t now()
+    {
+        return time_us_32();
+    }
+
+    void record(const Probe probe, const uint32_t start)
+    {
+        auto duration = time_us_32() - start;
+        auto core = get_core_num();
+        if (resetRequested[core])
+        {
+            clearStats(core);
+            resetRequested[core] = false;
+        }
+
+        auto &s = stats[core][probe];
+        s.count++;
+        s.total += duration;
+        s.min = s.count > 1 ? std::min(s.min, duration) : duration;
+        s.max = std::max(s.max, duration);
+        s.hist[std::min<uint8_t>(std::bit_width(duration), HIST_BUCKETS - 1)]++;
+    }
+
+    static void cmdPerfResetCallback(Console::Args args)
+    {
+        // Each core clears its own statistics on the next record
+        resetRequested[0] = true;
+        resetRequested[1] = true;
+        ULOG_INFO("Perf statistics reset");
+    }
+
+    static void cmdPerfCallback(Console::Args args)
+    {
+
+        for (uint8_t core = 0; core < 2; core++)
+        {
+            ULOG_INFO("Core %d: probe      count     min     avg     max (us)", core);
+            for (uint8_t p = 0; p < PROBE_COUNT; p++)
+            {
+                auto s = stats[core][p]; // A copy, the other core may be writing
+                if (!s.count)
+                    continue;
+
+                ULOG_INFO("  %-14s %-9u %-7u %-7u %u", PROBE_NAMES[p], s.count, s.min,
+                          static_cast<unsigned>(s.total / s.count), s.max);
+
+                // Bucket i holds the durations below 2^i us, the last one everything above
+                char line[HIST_BUCKETS * 16];
+                size_t len = 0;
+                uint8_t last = HIST_BUCKETS - 1;
+                while (last && !s.hist[last])
+                    last--;
+                for (uint8_t i = 0; i <= last && len < sizeof(line); i++)
+                {
+                    if (i == HIST_BUCKETS - 1)
+                        len += snprintf(line + len, sizeof(line) - len, " >=%u:%u", 1u << (i - 1), s.hist[i]);
+                    else
+                        len += snprintf(line + len, sizeof(line) - len, " <%u:%u", 1u << i, s.hist[i]);
+                }
+                Log::flush(); // The histogram goes after its log line
+                Hal::serialPrintf("   %s\n", line); // Longer than a log message
+            }
+        }
+    }
+
+    void init()
+    {
+        clearStats(0);
+        clearStats(1);
+
+        static const Console::Command perfSubcommands[]{{"reset", nullptr, 0, 0, cmdPerfResetCallback}};
+        Console::Command perfCmd{"perf", help_perf, 0, 0, cmdPerfCallback, {}, perfSubcommands};
+        Console::registerCommand(perfCmd);
+    }
+
+} // namespace Perf
+
+#else
+
+#include "Perf.h"
+
+namespace Perf
+{
+    void init()
+    {
+    }
+
+} // namespace Perf
+
+#endif
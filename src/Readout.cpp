@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "FixedPoint.hpp"
+#include "Log.h"
+#include "Readout.h"
+
+void Readout::create(lv_obj_t *parent, const lv_font_t *font, const uint8_t cellCount)
+{
+    this->font = font;
+    this->cellCount = std::min(cellCount, MAX_CELLS);
+    memset(cells, ' ', sizeof(cells));
+
+    cellWidth = 0;
+    for (char c = '0'; c <= '9'; c++)
+        cellWidth = std::max<int32_t>(cellWidth, lv_font_get_glyph_width(font, c, 0));
+
+    // No background, border or padding, only the cells are drawn
+    obj = lv_obj_create(parent);
+    lv_obj_remove_style_all(obj);
+    lv_obj_remove_flag(obj, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_set_style_text_font(obj, font, LV_PART_MAIN);
+    lv_obj_set_size(obj, cellWidth * this->cellCount, lv_font_get_line_height(font));
+    lv_obj_add_event_cb(obj, onDraw, LV_EVENT_DRAW_MAIN, this);
+
+    // Room for the glyphs up to twice as wide as a digit in the first and the last cell
+    lv_obj_add_event_cb(obj, [](lv_event_t *ev)
+                        { lv_event_set_ext_draw_size(ev, static_cast<Readout *>(lv_event_get_user_data(ev))->cellWidth / 2); },
+                        LV_EVENT_REFR_EXT_DRAW_SIZE, this);
+    lv_obj_refresh_ext_draw_size(obj);
+}
+
+void Readout::setText(const char *text)
+{
+    if (!obj)
+    {
+        ULOG_ERROR("Cannot update the readout: not created");
+        return;
+    }
+
+    auto len = strlen(text);
+    auto skip = len > cellCount ? len - cellCount : 0;
+    auto pad = cellCount - (len - skip);
+    for (uint8_t i = 0; i < cellCount; i++)
+    {
+        char c = i < pad ? ' ' : text[skip + i - pad];
+        if (c == cells[i])
+            continue;
+
+        // Both glyphs are covered, the old one is erased and the new one drawn
+        lv_area_t oldArea, newArea;
+        getCellArea(i, cells[i], oldArea);
+        getCellArea(i, c, newArea);
+        lv_area_t area{std::min(oldArea.x1, newArea.x1), oldArea.y1, std::max(oldArea.x2, newArea.x2), oldArea.y2};
+        lv_obj_invalidate_area(obj, &area);
+        cells[i] = c;
+    }
+}
+
+void Readout::setValue(const int32_t value, const char unit)
+{
+    if (value == FixedPoint::INVALID)
+    {
+        setText("----");
+        return;
+    }
+    if (value == FixedPoint::OVERLOAD)
+    {
+        setText("Overload");
+        return;
+    }
+
+    // Rounded to hundredths without going through floats
+    auto magnitude = value < 0 ? -static_cast<int64_t>(value) : value;
+    auto hundredths = static_cast<uint32_t>((magnitude + 5000) / 10000);
+    char text[MAX_CELLS + 1];
+    snprintf(text, sizeof(text), "%s%u.%02u %c", value < 0 && hundredths ? "-" : "",
+             static_cast<unsigned>(hundredths / 100), static_cast<unsigned>(hundredths % 100), unit);
+    setText(text);
+}
+
+void Readout::getCellArea(const uint8_t index, const char c, lv_area_t &area) const
+{
+    auto overhang = std::max<int32_t>(0, (lv_font_get_glyph_width(font, c, 0) - cellWidth + 1) / 2);
+    lv_obj_get_coords(obj, &area);
+    area.x1 += index * cellWidth - overhang;
+    area.x2 = area.x1 + cellWidth + 2 * overhang - 1;
+}
+
+void Readout::onDraw(lv_event_t *ev)
+{
+    auto self = static_cast<Readout *>(lv_event_get_user_data(ev));
+    auto layer = lv_event_get_layer(ev);
+
+    lv_draw_label_dsc_t dsc;
+    lv_draw_label_dsc_init(&dsc);
+    lv_obj_init_draw_label_dsc(self->obj, LV_PART_MAIN, &dsc);
+    dsc.align = LV_TEXT_ALIGN_CENTER;
+
+    for (uint8_t i = 0; i < self->cellCount; i++)
+    {
+        if (self->cells[i] == ' ')
+            continue;
+
+        // Centered in the cell, the glyphs wider than a digit overhang the neighbours evenly
+        char text[2]{self->cells[i], '\0'};
+        dsc.text = text;
+        dsc.text_local = 1;
+        lv_area_t area;
+        self->getCellArea(i, self->cells[i], area);
+        lv_draw_label(layer, &dsc, &area);
+    }
+}
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cstring>
+
+#include "AdcSampler.h"
+#include "Capture.h"
+#include "Hal.h"
+#include "Log.h"
+#include "SampleStream.h"
+#include "SerialTakeover.h"
+
+namespace SampleStream
+{
+    static bool active = false;
+    static Mode mode;
+    static uint32_t divider = 1;
+    static uint32_t blockIndex = 0;
+    static uint32_t pairPhase = 0; // Index of the next pair kept in the next block
+    static uint32_t sequence = 0;
+    static uint32_t written = 0;
+    static uint32_t dropped = 0;
+    static uint32_t adcDroppedStart = 0;
+
+    std::size_t cobsEncode(std::span<const uint8_t> in, uint8_t *out)
+    {
+        std::size_t codePos = 0;
+        std::size_t len = 1;
+        uint8_t code = 1;
+        for (auto b : in)
+        {
+            if (b)
+            {
+                out[len++] = b;
+                code++;
+            }
+            if (!b || code == 0xFF)
+            {
+                out[codePos] = code;
+                codePos = len++;
+                code = 1;
+            }
+        }
+        out[codePos] = code;
+        return len;
+    }
+
+    std::size_t cobsDecode(std::span<const uint8_t> in, uint8_t *out)
+    {
+        std::size_t len = 0;
+        for (std::size_t i = 0; i < in.size();)
+        {
+            uint8_t code = in[i++];
+            if (!code || i + code - 1 > in.size())
+                return 0;
+            for (uint8_t j = 1; j < code; j++)
+                out[len++] = in[i++];
+            if (code != 0xFF && i < in.size())
+                out[len++] = 0;
+        }
+        return len;
+    }
+
+    /**
+     * @brief Append the CRC to a payload and encode the frame
+     *
+     * @param payload The payload, with 2 bytes of room after it for the CRC
+     * @param len The payload length
+     * @param frame The frame, with the room given by MAX_FRAME for the payload length
+     * @return The frame length, with the terminating zero
+     */
+    static std::size_t encodeFrame(uint8_t *payload, const std::size_t len, uint8_t *frame)
+    {
+        auto crc = crc16({payload, len});
+        payload[len] = crc;
+        payload[len + 1] = crc >> 8;
+
+        auto frameLen = cobsEncode({payload, len + 2}, frame);
+        frame[frameLen++] = 0;
+        return frameLen;
+    }
+
+    /**
+     * @brief Encode and write a frame
+     *
+     * @param payload The payload, with 2 bytes of room after it for the CRC
+     * @param len The payload length
+     * @param force Write even if the serial port is busy, for the END frame
+     * @return false if the frame was dropped
+     */
+    static bool writeFrame(uint8_t *payload, const std::size_t len, const bool force)
+    {
+        static uint8_t frame[MAX_FRAME];
+        auto frameLen = encodeFrame(payload, len, frame);
+        if (!force && !SerialTakeover::canWrite(frameLen))
+            return false;
+
+        SerialTakeover::write(frame, frameLen);
+        return true;
+    }
+
+    /**
+     * @brief Write the END frame and give the serial port back to the console
+     */
+    static void stop()
+    {
+        alignas(4) static uint8_t payload[sizeof(FrameHeader) + sizeof(EndInfo) + 2];
+        FrameHeader header{.type = END, .scales = 0, .count = 0, .sequence = sequence,
+                           .timestamp = Hal::micros(), .dropped = dropped};
+        EndInfo info{.frames = written, .adcDropped = AdcSampler::getDroppedBlocks() - adcDroppedStart};
+        memcpy(payload, &header, sizeof(header));
+        memcpy(payload + sizeof(header), &info, sizeof(info));
+        writeFrame(payload, sizeof(header) + sizeof(info), true);
+
+        active = false;
+        SerialTakeover::release();
+        ULOG_INFO("Stream finished, %u frames, %u dropped", static_cast<unsigned>(written), static_cast<unsigned>(dropped));
+    }
+
+    void start(const Mode m, const uint32_t d)
+    {
+        mode = m;
+        divider = std::max<uint32_t>(d, 1);
+        blockIndex = 0;
+        pairPhase = 0;
+        sequence = 0;
+        written = 0;
+        dropped = 0;
+        adcDroppedStart = AdcSampler::getDroppedBlocks();
+
+        // Written with the first block
+        alignas(4) static uint8_t payload[sizeof(FrameHeader) + sizeof(StartInfo) + 2];
+        static uint8_t frame[sizeof(payload) + sizeof(payload) / 254 + 2];
+        FrameHeader header{.type = START, .scales = 0, .count = 0, .sequence = 0, .timestamp = Hal::micros(), .dropped = 0};
+        StartInfo info{.version = VERSION, .mode = static_cast<uint8_t>(mode), .reserved = 0,
+                       .periodNs = mode == Mode::RAW ? divider * (1000000000 / CHANNEL_RATE) : divider * BLOCK_PERIOD_NS};
+        memcpy(payload, &header, sizeof(header));
+        memcpy(payload + sizeof(header), &info, sizeof(info));
+        SerialTakeover::take(frame, encodeFrame(payload, sizeof(header) + sizeof(info), frame));
+        active = true;
+    }
+
+    void writeBlock(std::span<const uint16_t> block, const uint8_t uScale, const uint8_t iScale,
+                    const Reading &reading)
+    {
+        if (!active)
+            return;
+
+        if (!SerialTakeover::nextBlock())
+        {
+            stop();
+            return;
+        }
+
+        alignas(4) static uint8_t payload[MAX_PAYLOAD + 2];
+        FrameHeader header{.type = RAW, .scales = static_cast<uint8_t>(uScale | iScale << 2), .count = 0,
+                           .sequence = sequence, .timestamp = Hal::micros(), .dropped = dropped};
+
+        std::size_t len = sizeof(header);
+        if (mode == Mode::RAW)
+        {
+            // The pairs kept are packed like the captures, 2 codes in 3 bytes
+            // The phase carries over, so the spacing stays even across the blocks
+            uint16_t pair[2];
+            auto i = pairPhase;
+            for (; i < BLOCK_PAIRS; i += divider, len += 3)
+            {
+                pair[0] = block[i * 2];
+                pair[1] = block[i * 2 + 1];
+                Capture::pack(pair, payload + len);
+                header.count++;
+            }
+            pairPhase = i - BLOCK_PAIRS;
+            if (!header.count)
+                return;
+            header.type = RAW;
+        }
+        else
+        {
+            if (blockIndex++ % divider)
+                return;
+            memcpy(payload + len, &reading, sizeof(reading));
+            len += sizeof(reading);
+            header.count = 1;
+            header.type = FILTERED;
+        }
+
+        memcpy(payload, &header, sizeof(header));
+        sequence++;
+        if (writeFrame(payload, len, false))
+            written++;
+        else
+            dropped++;
+    }
+
+    bool isActive()
+    {
+        return active;
+    }
+
+} // namespace SampleStream
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <Arduino.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+#include "Console.h"
+#include "Log.h"
+#include "Scheduler.h"
+
+extern "C"
+{
+    extern const char help_tasks[];
+}
+
+namespace Scheduler
+{
+    struct Task
+    {
+        const char *name;
+        TaskCb cb;
+        uint32_t period;
+        uint32_t deadline;
+        Policy policy;
+        uint64_t release; // Next release time in us since boot
+
+        // Statistics
+        uint32_t runs = 0;
+        uint32_t missedDeadlines = 0; // Started later than the deadline
+        uint32_t skippedReleases = 0; // Dropped by the policy
+        uint32_t maxLateness = 0;
+        uint32_t maxRunTime = 0;
+    };
+
+    static Task tasks[MAX_TASKS];
+    static uint8_t taskCount = 0;
+
+    static int alarmNum = -1;
+    static uint64_t idleTime = 0;
+    static uint64_t statsStart = 0;
+
+    static void onAlarm(uint alarm)
+    {
+        // Wake up the core even if it's just about to sleep
+        __sev();
+    }
+
+    static void resetStats()
+    {
+        for (uint8_t i = 0; i < taskCount; i++)
+        {
+            auto &t = tasks[i];
+            t.runs = 0;
+            t.missedDeadlines = 0;
+            t.skippedReleases = 0;
+            t.maxLateness = 0;
+            t.maxRunTime = 0;
+        }
+        idleTime = 0;
+        statsStart = time_us_64();
+    }
+
+    static void cmdTasksResetCallback(Console::Args args)
+    {
+        resetStats();
+        ULOG_INFO("Task statistics reset");
+    }
+
+    static void cmdTasksCallback(Console::Args args)
+    {
+        auto elapsed = time_us_64() - statsStart;
+        ULOG_INFO("Task       period  runs      missed  skipped max late  max run (us)");
+        for (uint8_t i = 0; i < taskCount; i++)
+        {
+            auto &t = tasks[i];
+            ULOG_INFO("%-10s %-7u %-9u %-7u %-7u %-9u %u", t.name, t.period, t.runs, t.missedDeadlines,
+                      t.skippedReleases, t.maxLateness, t.maxRunTime);
+        }
+        ULOG_INFO("Idle: %u%%", elapsed ? static_cast<unsigned>(idleTime * 100 / elapsed) : 0);
+    }
+
+    void init()
+    {
+        alarmNum = hardware_alarm_claim_unused(true);
+        hardware_alarm_set_callback(alarmNum, onAlarm);
+
+        static const Console::Command tasksSubcommands[]{{"reset", nullptr, 0, 0, cmdTasksResetCallback}};
+        Console::Command tasksCmd{"tasks", help_tasks, 0, 0, cmdTasksCallback, {}, tasksSubcommands};
+        Console::registerCommand(tasksCmd);
+    }
+
+    bool addTask(const char *name, const uint32_t periodUs, TaskCb cb, const Policy policy, const uint32_t deadlineUs)
+    {
+        if (taskCount >= MAX_TASKS || !periodUs)
+        {
+            ULOG_ERROR("Unable to add task %s", name);
+            return false;
+        }
+
+        tasks[taskCount++] = {
+            .name = name,
+            .cb = std::move(cb),
+            .period = periodUs,
+            .deadline = deadlineUs ? deadlineUs : periodUs,
+            .policy = policy,
+            .release = time_us_64(),
+        };
+        return true;
+    }
+
+    /**
+     * @brief Move the release of a task which has just run to the next period
+     */
+    static void advance(Task &t, const uint64_t now)
+    {
+        t.release += t.period;
+        if (t.release > now)
+            return;
+
+        // Behind by at least one more period
+        uint64_t behind = (now - t.release) / t.period + 1;
+        if (t.policy == Policy::CATCH_UP && behind <= MAX_CATCH_UP)
+            return;
+
+        // Too late to catch up, the later releases are dropped
+        if (t.policy == Policy::CATCH_UP)
+            behind -= MAX_CATCH_UP;
+        t.skippedReleases += behind;
+        t.release += behind * t.period;
+    }
+
+    void run()
+    {
+        if (alarmNum < 0)
+            init();
+
+        resetStats();
+        while (true)
+        {
+            auto now = time_us_64();
+            auto next = UINT64_MAX;
+
+            for (uint8_t i = 0; i < taskCount; i++)
+            {
+                auto &t = tasks[i];
+                if (t.release <= now)
+                {
+                    uint32_t lateness = now - t.release;
+                    t.maxLateness = std::max(t.maxLateness, lateness);
+                    t.missedDeadlines += lateness > t.deadline;
+
+                    t.cb();
+                    t.runs++;
+
+                    auto end = time_us_64();
+                    t.maxRunTime = std::max<uint32_t>(t.maxRunTime, end - now);
+                    advance(t, end);
+                    now = end;
+                }
+                next = std::min(next, t.release);
+            }
+
+            // Sleep until the next release, the alarm fires right away if it has passed
+            if (next > now && !hardware_alarm_set_target(alarmNum, from_us_since_boot(next)))
+            {
+                auto sleepStart = time_us_64();
+                while (time_us_64() < next)
+                    __wfe();
+                idleTime += time_us_64() - sleepStart;
+            }
+        }
+    }
+
+} // namespace Scheduler
@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <string_view>
+
+#include "Console.h"
+#include "FixedPoint.hpp"
+#include "Hal.h"
+#include "Scpi.h"
+#include "config.h"
+
+namespace Scpi
+{
+    // The standard error numbers
+    enum Error : int16_t
+    {
+        NO_ERROR = 0,
+        SYNTAX_ERROR = -102,
+        PARAMETER_NOT_ALLOWED = -108,
+        MISSING_PARAMETER = -109,
+        UNDEFINED_HEADER = -113,
+        SETTINGS_CONFLICT = -221,
+        DATA_OUT_OF_RANGE = -222,
+        TOO_MUCH_DATA = -223,
+        ILLEGAL_PARAMETER_VALUE = -224,
+        QUEUE_OVERFLOW = -350,
+    };
+
+    // Mnemonics of a header at most
+    constexpr uint8_t MAX_DEPTH = 6;
+
+    using Handler = void (*)(std::string_view param, Channel channel);
+
+    struct Command
+    {
+        const char *pattern; // In the SCPI notation, the long forms with the short forms in upper case
+        Channel channel;
+        bool setParam; // Whether the command takes a parameter, the queries take none
+        Handler set;
+        Handler query;
+    };
+
+    static GetRangeCb getRange;
+    static SetRangeCb setRange;
+
+    // The latest readings of both channels, in a ring
+    static int32_t readings[2][SCPI_MAX_AVERAGE];
+    static uint8_t readingPos = 0;
+    static uint8_t readingCount = 0;
+    static uint8_t averageCount = 1;
+
+    // Oldest first
+    static int16_t errors[SCPI_ERROR_QUEUE_LENGTH];
+    static uint8_t errorCount = 0;
+
+    // The responses of the queries of a line
+    static char response[SCPI_RESPONSE_LENGTH];
+    static std::size_t responseLen = 0;
+
+    static void addError(const int16_t error)
+    {
+        if (errorCount < SCPI_ERROR_QUEUE_LENGTH)
+            errors[errorCount++] = error;
+        else
+            errors[SCPI_ERROR_QUEUE_LENGTH - 1] = QUEUE_OVERFLOW;
+    }
+
+    static const char *getErrorMessage(const int16_t error)
+    {
+        switch (error)
+        {
+        case SYNTAX_ERROR:
+            return "Syntax error";
+        case PARAMETER_NOT_ALLOWED:
+            return "Parameter not allowed";
+        case MISSING_PARAMETER:
+            return "Missing parameter";
+        case UNDEFINED_HEADER:
+            return "Undefined header";
+        case SETTINGS_CONFLICT:
+            return "Settings conflict";
+        case DATA_OUT_OF_RANGE:
+            return "Data out of range";
+        case TOO_MUCH_DATA:
+            return "Too much data";
+        case ILLEGAL_PARAMETER_VALUE:
+            return "Illegal parameter value";
+        case QUEUE_OVERFLOW:
+            return "Queue overflow";
+        default:
+            return "No error";
+        }
+    }
+
+    /**
+     * @brief Add a response, separated from the previous one of the line
+     */
+    __attribute__((format(printf, 1, 2))) static void respond(const char *fmt, ...)
+    {
+        // Room is kept for a separator and the end of line
+        if (responseLen + 2 >= sizeof(response))
+        {
+            addError(TOO_MUCH_DATA);
+            return;
+        }
+        if (responseLen)
+            response[responseLen++] = ';';
+
+        auto room = sizeof(response) - responseLen - 1;
+        va_list args;
+        va_start(args, fmt);
+        std::size_t len = std::max(0, vsnprintf(response + responseLen, room, fmt, args));
+        va_end(args);
+
+        if (len >= room)
+        {
+            addError(TOO_MUCH_DATA);
+            len = room - 1;
+        }
+        responseLen += len;
+    }
+
+    /**
+     * @brief Mean of the latest readings, up to the average count, stopping at a sentinel
+     *
+     * @return The mean, or the sentinel if the latest reading is one
+     */
+    static int32_t getAverage(const Channel channel)
+    {
+        int64_t sum = 0;
+        uint8_t n = 0;
+        for (; n < std::min(averageCount, readingCount); n++)
+        {
+            auto value = readings[static_cast<uint8_t>(channel)][(readingPos + SCPI_MAX_AVERAGE - 1 - n) % SCPI_MAX_AVERAGE];
+            if (value == FixedPoint::INVALID || value == FixedPoint::OVERLOAD)
+            {
+                if (!n)
+                    return value;
+                break;
+            }
+            sum += value;
+        }
+        return n ? sum / n : FixedPoint::INVALID;
+    }
+
+    static bool equalsIgnoreCase(const std::string_view a, const std::string_view b)
+    {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+                                                  { return toupper(x) == toupper(y); });
+    }
+
+    /**
+     * @brief Parse a whole integer parameter
+     *
+     * @return false if it isn't an integer, the error is queued
+     */
+    static bool parseInt(const std::string_view param, long &value)
+    {
+        char buf[16];
+        if (param.empty() || param.size() >= sizeof(buf))
+        {
+            addError(ILLEGAL_PARAMETER_VALUE);
+            return false;
+        }
+        *std::copy(param.begin(), param.end(), buf) = '\0';
+
+        char *end;
+        value = std::strtol(buf, &end, 10);
+        if (*end)
+        {
+            addError(ILLEGAL_PARAMETER_VALUE);
+            return false;
+        }
+        return true;
+    }
+
+    static void queryIdn(std::string_view, Channel)
+    {
+        respond("%s", SCPI_IDN);
+    }
+
+    static void setRst(std::string_view, Channel)
+    {
+        averageCount = 1;
+        if (!setRange(Channel::VOLTAGE, AUTO_RANGE) || !setRange(Channel::CURRENT, AUTO_RANGE))
+            addError(SETTINGS_CONFLICT);
+    }
+
+    static void setCls(std::string_view, Channel)
+    {
+        errorCount = 0;
+    }
+
+    static void queryOpc(std::string_view, Channel)
+    {
+        respond("1"); // Every command completes before the response
+    }
+
+    static void queryMeasure(std::string_view, Channel channel)
+    {
+        auto value = getAverage(channel);
+        if (value == FixedPoint::OVERLOAD)
+            respond("9.9E37");
+        else if (value == FixedPoint::INVALID)
+            respond("9.91E37"); // Not a number
+        else
+        {
+            auto magnitude = value < 0 ? -static_cast<int64_t>(value) : value;
+            respond("%s%u.%06u", value < 0 ? "-" : "", static_cast<unsigned>(magnitude / 1000000),
+                    static_cast<unsigned>(magnitude % 1000000));
+        }
+    }
+
+    static void setScale(std::string_view param, Channel channel)
+    {
+        long scale = AUTO_RANGE;
+        if (!equalsIgnoreCase(param, "AUTO"))
+        {
+            if (!parseInt(param, scale))
+                return;
+            if (scale < 0 || scale > 3)
+            {
+                addError(DATA_OUT_OF_RANGE);
+                return;
+            }
+        }
+        if (!setRange(channel, scale))
+            addError(SETTINGS_CONFLICT);
+    }
+
+    static void queryScale(std::string_view, Channel channel)
+    {
+        respond("%u", static_cast<unsigned>(getRange(channel).scale));
+    }
+
+    static void setAuto(std::string_view param, Channel channel)
+    {
+        bool on;
+        if (equalsIgnoreCase(param, "ON") || param == "1")
+            on = true;
+        else if (equalsIgnoreCase(param, "OFF") || param == "0")
+            on = false;
+        else
+        {
+            addError(ILLEGAL_PARAMETER_VALUE);
+            return;
+        }
+
+        // Turning it off keeps the active scale
+        if (!setRange(channel, on ? AUTO_RANGE : getRange(channel).scale))
+            addError(SETTINGS_CONFLICT);
+    }
+
+    static void queryAuto(std::string_view, Channel channel)
+    {
+        respond("%u", getRange(channel).autoRange ? 1 : 0);
+    }
+
+    static void setAverageCount(std::string_view param, Channel)
+    {
+        long count;
+        if (!parseInt(param, count))
+            return;
+        if (count < 1 || count > SCPI_MAX_AVERAGE)
+        {
+            addError(DATA_OUT_OF_RANGE);
+            return;
+        }
+        averageCount = count;
+    }
+
+    static void queryAverageCount(std::string_view, Channel)
+    {
+        respond("%u", static_cast<unsigned>(averageCount));
+    }
+
+    static void queryError(std::string_view, Channel)
+    {
+        int16_t error = NO_ERROR;
+        if (errorCount)
+        {
+            error = errors[0];
+            std::copy(errors + 1, errors + errorCount, errors);
+            errorCount--;
+        }
+        respond("%d,\"%s\"", static_cast<int>(error), getErrorMessage(error));
+    }
+
+    static void setLocal(std::string_view, Channel)
+    {
+        Console::setRemote(false);
+    }
+
+    static constexpr Command COMMANDS[]{
+        {"*IDN", Channel::VOLTAGE, false, nullptr, queryIdn},
+        {"*RST", Channel::VOLTAGE, false, setRst, nullptr},
+        {"*CLS", Channel::VOLTAGE, false, setCls, nullptr},
+        {"*OPC", Channel::VOLTAGE, false, nullptr, queryOpc},
+        {"MEASure:VOLTage[:DC]", Channel::VOLTAGE, false, nullptr, queryMeasure},
+        {"MEASure:CURRent[:DC]", Channel::CURRENT, false, nullptr, queryMeasure},
+        {"CONFigure:RANGe:VOLTage", Channel::VOLTAGE, true, setScale, queryScale},
+        {"CONFigure:RANGe:CURRent", Channel::CURRENT, true, setScale, queryScale},
+        {"CONFigure:RANGe:VOLTage:AUTO", Channel::VOLTAGE, true, setAuto, queryAuto},
+        {"CONFigure:RANGe:CURRent:AUTO", Channel::CURRENT, true, setAuto, queryAuto},
+        {"[SENSe]:AVERage:COUNt", Channel::VOLTAGE, true, setAverageCount, queryAverageCount},
+        {"SYSTem:ERRor[:NEXT]", Channel::VOLTAGE, false, nullptr, queryError},
+        {"SYSTem:LOCal", Channel::VOLTAGE, false, setLocal, nullptr},
+    };
+
+    struct Node
+    {
+        std::string_view name;
+        bool optional;
+    };
+
+    /**
+     * @brief Split a pattern into its nodes
+     *
+     * @return The node count
+     */
+    static uint8_t parsePattern(const char *pattern, Node (&nodes)[MAX_DEPTH])
+    {
+        uint8_t count = 0;
+        bool optional = false;
+        for (auto p = pattern; *p && count < MAX_DEPTH;)
+        {
+            if (*p == '[' || *p == ']' || *p == ':')
+            {
+                optional = *p == '[' || (optional && *p == ':');
+                p++;
+                continue;
+            }
+
+            auto start = p;
+            while (*p && *p != ':' && *p != '[' && *p != ']')
+                p++;
+            nodes[count++] = {{start, static_cast<std::size_t>(p - start)}, optional};
+        }
+        return count;
+    }
+
+    /**
+     * @brief Match a mnemonic against the long form of a node, or its short form, the leading upper case part
+     */
+    static bool matchMnemonic(const std::string_view mnemonic, const std::string_view name)
+    {
+        auto shortLen = std::find_if(name.begin(), name.end(), [](char c)
+                                     { return islower(c); }) -
+                        name.begin();
+        return equalsIgnoreCase(mnemonic, name.substr(0, shortLen)) || equalsIgnoreCase(mnemonic, name);
+    }
+
+    static bool matchNodes(std::span<const Node> nodes, std::span<const std::string_view> mnemonics)
+    {
+        if (nodes.empty())
+            return mnemonics.empty();
+        if (!mnemonics.empty() && matchMnemonic(mnemonics[0], nodes[0].name) &&
+            matchNodes(nodes.subspan(1), mnemonics.subspan(1)))
+            return true;
+        return nodes[0].optional && matchNodes(nodes.subspan(1), mnemonics);
+    }
+
+    static std::string_view trim(std::string_view s)
+    {
+        auto start = s.find_first_not_of(" \t");
+        if (start == std::string_view::npos)
+            return {};
+        return s.substr(start, s.find_last_not_of(" \t") - start + 1);
+    }
+
+    /**
+     * @brief Run a command of a line
+     *
+     * @param unit The command with its parameter
+     * @param path The node of the previous command, the relative headers start from it
+     * @param pathLen The mnemonic count of the path
+     */
+    static void runCommand(std::string_view unit, std::string_view (&path)[MAX_DEPTH], uint8_t &pathLen)
+    {
+        unit = trim(unit);
+        if (unit.empty())
+            return;
+
+        auto headerEnd = std::min(unit.find_first_of(" \t"), unit.size());
+        auto header = unit.substr(0, headerEnd);
+        auto param = trim(unit.substr(headerEnd));
+        bool query = header.back() == '?';
+        if (query)
+            header.remove_suffix(1);
+
+        std::string_view mnemonics[MAX_DEPTH];
+        uint8_t count = 0;
+        if (header.starts_with('*'))
+            mnemonics[count++] = header; // A common command, the path is kept
+        else
+        {
+            if (header.starts_with(':'))
+            {
+                header.remove_prefix(1);
+                pathLen = 0;
+            }
+            std::copy(path, path + pathLen, mnemonics);
+            count = pathLen;
+            while (true)
+            {
+                auto end = std::min(header.find(':'), header.size());
+                if (!end || count == MAX_DEPTH)
+                {
+                    addError(end ? UNDEFINED_HEADER : SYNTAX_ERROR);
+                    return;
+                }
+                mnemonics[count++] = header.substr(0, end);
+                if (end == header.size())
+                    break;
+                header.remove_prefix(end + 1);
+            }
+
+            std::copy(mnemonics, mnemonics + count - 1, path);
+            pathLen = count - 1;
+        }
+
+        for (auto &cmd : COMMANDS)
+        {
+            Node nodes[MAX_DEPTH];
+            auto nodeCount = parsePattern(cmd.pattern, nodes);
+            if (!matchNodes(std::span(nodes, nodeCount), std::span(mnemonics, count)))
+                continue;
+
+            auto handler = query ? cmd.query : cmd.set;
+            if (!handler)
+                addError(UNDEFINED_HEADER);
+            else if (!param.empty() && (query || !cmd.setParam))
+                addError(PARAMETER_NOT_ALLOWED);
+            else if (param.empty() && !query && cmd.setParam)
+                addError(MISSING_PARAMETER);
+            else
+                handler(param, cmd.channel);
+            return;
+        }
+        addError(UNDEFINED_HEADER);
+    }
+
+    void init(GetRangeCb getRangeCb, SetRangeCb setRangeCb)
+    {
+        getRange = getRangeCb;
+        setRange = setRangeCb;
+        Console::setLineHandler(handleLine);
+    }
+
+    void pushReading(const int32_t voltage, const int32_t current)
+    {
+        readings[static_cast<uint8_t>(Channel::VOLTAGE)][readingPos] = voltage;
+        readings[static_cast<uint8_t>(Channel::CURRENT)][readingPos] = current;
+        readingPos = (readingPos + 1) % SCPI_MAX_AVERAGE;
+        readingCount = std::min<uint8_t>(readingCount + 1, SCPI_MAX_AVERAGE);
+    }
+
+    bool handleLine(char *line, const std::size_t len)
+    {
+        std::string_view text(line, len);
+        auto first = text.substr(0, std::min(text.find_first_of(" \t;"), text.size()));
+        if (!first.starts_with('*') && first.find_first_of(":?") == std::string_view::npos)
+            return false;
+
+        std::string_view path[MAX_DEPTH];
+        uint8_t pathLen = 0;
+        responseLen = 0;
+        while (true)
+        {
+            auto end = std::min(text.find(';'), text.size());
+            runCommand(text.substr(0, end), path, pathLen);
+            if (end == text.size())
+                break;
+            text.remove_prefix(end + 1);
+        }
+
+        if (responseLen)
+        {
+            response[responseLen++] = '\n';
+            Hal::serialWrite(response, responseLen);
+        }
+        return true;
+    }
+
+} // namespace Scpi
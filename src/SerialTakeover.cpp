@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include "Console.h"
+#include "Hal.h"
+#include "SerialTakeover.h"
+#include "config.h"
+
+namespace SerialTakeover
+{
+    static bool active = false;
+    static const void *pendingOpening = nullptr;
+    static std::size_t pendingLen = 0;
+
+    void take(const void *opening, const std::size_t len)
+    {
+        // Drop what was typed so far, anything received from now on stops the stream
+        while (Hal::serialRead() >= 0)
+            ;
+
+        Console::setLogMuted(true);
+        pendingOpening = opening;
+        pendingLen = len;
+        active = true;
+    }
+
+    bool nextBlock()
+    {
+        if (Hal::serialRead() >= 0)
+            return false;
+
+        if (pendingOpening)
+        {
+            write(pendingOpening, pendingLen);
+            pendingOpening = nullptr;
+        }
+        return true;
+    }
+
+    bool canWrite(const std::size_t len)
+    {
+        return Hal::serialAvailableForWrite() >= std::min<std::size_t>(len, SERIAL_TX_ROOM);
+    }
+
+    void write(const void *data, const std::size_t len)
+    {
+        Hal::serialWrite(static_cast<const char *>(data), len);
+    }
+
+    void release()
+    {
+        pendingOpening = nullptr;
+        active = false;
+        Console::setLogMuted(false);
+    }
+
+    bool isActive()
+    {
+        return active;
+    }
+
+} // namespace SerialTakeover
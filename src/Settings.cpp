@@ -0,0 +1,213 @@
+#include <cstring>
+
+#include "Hal.h"
+#include "Journal.h"
+#include "Log.h"
+#include "Settings.h"
+#include "config.h"
+#include "FixedPoint.hpp"
+
+namespace Settings
+{
+    constexpr uint16_t SETTINGS_VERSION = 3;
+
+    // The payload of the journal records
+    struct __attribute__((packed)) MeterSettings
+    {
+        CalPoint vPoints[4][CAL_POINTS];
+        uint8_t vPointCounts[4];
+        CalPoint iPoints[4][CAL_POINTS];
+        uint8_t iPointCounts[4];
+        int16_t spikeWidths[AdcCorrection::SPIKE_COUNT];
+    };
+
+    // Version 2 layout, in the EEPROM sector
+    struct __attribute__((packed)) V2MeterSettings
+    {
+        uint8_t header;  // Should be 0x6A
+        uint8_t version; // Should be 2
+        MeterSettings payload;
+
+        uint8_t checksum; // XOR of the payload bytes
+    };
+
+    // Version 1 layout, in the EEPROM sector, a gain per scale
+    struct __attribute__((packed)) LegacyMeterSettings
+    {
+        uint8_t header; // Should be 0x69
+        float vScaleGains[4];
+        float iScaleGains[4];
+
+        uint8_t checksum; // XOR of the payload bytes
+    };
+
+    // Version 1 ADC correction, stored separately
+    struct __attribute__((packed)) LegacyAdcSettings
+    {
+        uint8_t header; // Should be 0x5A
+        int16_t spikeWidths[AdcCorrection::SPIKE_COUNT];
+
+        uint8_t checksum; // XOR of the payload bytes
+    };
+
+    constexpr auto LEGACY_ADC_SETTINGS_ADDR = 64;
+
+    /**
+     * @brief Calculate the sum of an byte (uint8_t) array by XOR
+     *
+     * @param data A pointer to the byte array
+     * @param len The length of the array
+     * @return uint8_t sum
+     */
+    static uint8_t calcSum(const void *data, const std::size_t len)
+    {
+        uint8_t sum = 0;
+        for (std::size_t i = 0; i < len; i++)
+        {
+            sum ^= *(reinterpret_cast<const uint8_t *>(data) + i);
+        }
+        return sum;
+    }
+
+    /**
+     * @brief Copy the calibration points of 4 scales into plain arrays for storing
+     */
+    static void packCalibrations(const ScaleCalibration (&cals)[4], CalPoint (&points)[4][CAL_POINTS], uint8_t (&counts)[4])
+    {
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            counts[s] = cals[s].getCount();
+            for (uint8_t i = 0; i < CAL_POINTS; i++)
+                points[s][i] = i < counts[s] ? cals[s].getPoint(i) : CalPoint{};
+        }
+    }
+
+    /**
+     * @brief Rebuild the calibrations of 4 scales from the stored points
+     */
+    static void unpackCalibrations(const CalPoint (&points)[4][CAL_POINTS], const uint8_t (&counts)[4], ScaleCalibration (&cals)[4])
+    {
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            cals[s].clear();
+            for (uint8_t i = 0; i < std::min(counts[s], CAL_POINTS); i++)
+                cals[s].addPoint(points[s][i].raw, points[s][i].value);
+        }
+    }
+
+    /**
+     * @brief Read a structure from the EEPROM sector of the earlier versions
+     */
+    template <typename T>
+    static void readLegacy(const std::size_t addr, T &data)
+    {
+        memcpy(&data, Hal::legacyStorageArea().data() + addr, sizeof(data));
+    }
+
+    /**
+     * @brief Unpack the calibrations and the ADC correction from the stored settings
+     */
+    static void unpack(const MeterSettings &settings, ScaleCalibration (&uCals)[4], ScaleCalibration (&iCals)[4],
+                       int16_t (&spikeWidths)[AdcCorrection::SPIKE_COUNT])
+    {
+        // The packed members can't be referenced, so go through local arrays
+        CalPoint points[4][CAL_POINTS];
+        uint8_t counts[4];
+        memcpy(points, settings.vPoints, sizeof(points));
+        memcpy(counts, settings.vPointCounts, sizeof(counts));
+        unpackCalibrations(points, counts, uCals);
+        memcpy(points, settings.iPoints, sizeof(points));
+        memcpy(counts, settings.iPointCounts, sizeof(counts));
+        unpackCalibrations(points, counts, iCals);
+        memcpy(spikeWidths, settings.spikeWidths, sizeof(spikeWidths));
+    }
+
+    bool save(const ScaleCalibration (&uCals)[4], const ScaleCalibration (&iCals)[4],
+              const int16_t (&spikeWidths)[AdcCorrection::SPIKE_COUNT])
+    {
+        // The packed members can't be referenced, so go through local arrays
+        CalPoint points[4][CAL_POINTS];
+        uint8_t counts[4];
+        MeterSettings settings;
+
+        packCalibrations(uCals, points, counts);
+        memcpy(settings.vPoints, points, sizeof(points));
+        memcpy(settings.vPointCounts, counts, sizeof(counts));
+        packCalibrations(iCals, points, counts);
+        memcpy(settings.iPoints, points, sizeof(points));
+        memcpy(settings.iPointCounts, counts, sizeof(counts));
+        memcpy(settings.spikeWidths, spikeWidths, sizeof(spikeWidths));
+
+        Journal::CommitStats stats;
+        if (!Journal::append(SETTINGS_VERSION, &settings, sizeof(settings), stats))
+            return false;
+
+        ULOG_INFO("Settings committed in %u us, %u page(s), other core paused %u us at most%s",
+                  stats.totalUs, stats.pages, stats.maxLockoutUs, stats.erased ? " (sector erased)" : "");
+        return true;
+    }
+
+    void load(ScaleCalibration (&uCals)[4], ScaleCalibration (&iCals)[4],
+              int16_t (&spikeWidths)[AdcCorrection::SPIKE_COUNT])
+    {
+        MeterSettings settings;
+        uint16_t version;
+        if (Journal::init() && Journal::readLatest(version, &settings, sizeof(settings)) == sizeof(settings) &&
+            version == SETTINGS_VERSION)
+        {
+            unpack(settings, uCals, iCals, spikeWidths);
+            return;
+        }
+
+        // The earlier versions are migrated from the EEPROM sector, which is left as it is
+        V2MeterSettings v2;
+        readLegacy(0, v2);
+        if (v2.header == 0x6A && v2.version == 2 && calcSum(&v2, sizeof(v2) - 1) == v2.checksum)
+        {
+            unpack(v2.payload, uCals, iCals, spikeWidths);
+            if (save(uCals, iCals, spikeWidths))
+                ULOG_INFO("Settings migrated to version %d", SETTINGS_VERSION);
+            return;
+        }
+
+        bool migrated = false;
+        float vScaleGains[4];
+        float iScaleGains[4];
+        LegacyMeterSettings legacy;
+        readLegacy(0, legacy);
+        if (legacy.header == 0x69 && calcSum(&legacy, sizeof(legacy) - 1) == legacy.checksum)
+        {
+            memcpy(vScaleGains, legacy.vScaleGains, sizeof(vScaleGains));
+            memcpy(iScaleGains, legacy.iScaleGains, sizeof(iScaleGains));
+            migrated = true;
+        }
+        else
+        {
+            ULOG_WARNING("No valid calibration stored.");
+            memcpy(vScaleGains, U_SCALE_DEF_GAINS, sizeof(vScaleGains));
+            memcpy(iScaleGains, I_SCALE_DEF_GAIN, sizeof(iScaleGains));
+        }
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            uCals[s].setGain(FixedPoint::toQ16(vScaleGains[s]));
+            iCals[s].setGain(FixedPoint::toQ16(iScaleGains[s]));
+        }
+
+        LegacyAdcSettings legacyAdc;
+        readLegacy(LEGACY_ADC_SETTINGS_ADDR, legacyAdc);
+        if (legacyAdc.header == 0x5A && calcSum(&legacyAdc, sizeof(legacyAdc) - 1) == legacyAdc.checksum)
+        {
+            memcpy(spikeWidths, legacyAdc.spikeWidths, sizeof(spikeWidths));
+            migrated = true;
+        }
+        else
+        {
+            ULOG_WARNING("No valid ADC correction stored.");
+            memcpy(spikeWidths, ADC_DEF_SPIKE_WIDTHS, sizeof(spikeWidths));
+        }
+
+        if (migrated && save(uCals, iCals, spikeWidths))
+            ULOG_INFO("Settings migrated to version %d", SETTINGS_VERSION);
+    }
+
+} // namespace Settings
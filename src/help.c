@@ -2,11 +2,50 @@ const char help_help[] = "Display the help message\n"
                          "  Usage: help [command]\n";
 
 const char help_cal[] = "Calibrate the current and voltage scales\n"
-                        "  Usage: cal <start|save|exit|scale|in|gains> [options]\n"
-                        "\tcal start <u|i> - Start the calibration process for the voltage or current scale, "
-                        "should be run before other calibration commands.\n"
+                        "  Usage: cal <start|save|exit|scale|in|auto|clear|gains> [options]\n"
+                        "\tcal start <u|i|adc> - Start the calibration process for the voltage or current scale, "
+                        "should be run before other calibration commands. "
+                        "'adc' captures the ADC linearity from a slow full-scale ramp on the voltage input.\n"
                         "\tcal save - Save the calibration data for the voltage or current scale and exit\n"
                         "\tcal exit - Exit the calibration process and discard the changes\n"
                         "\tcal scale [level] - Show or set the scale level(0-3)\n"
-                        "\tcal in <value> - Input the actual value(in V or A)\n"
-                        "\tcal gains - Show the current gains setting\n";
+                        "\tcal in <value> - Input the actual value(in V or A) as a calibration point of the active scale, "
+                        "up to 4 points per scale. A single point sets the gain, more points also correct the offset and the curve.\n"
+                        "\tcal auto <value> [samples] - Collect the actual value(in V or A) as a reference point of the active scale "
+                        "over 100 blocks of 10ms by default, the point is rejected if the input is noisy or not settled. "
+                        "The scale calibration is replaced by the least-squares gain and offset over its reference points, "
+                        "shown with the residuals and the uncertainty.\n"
+                        "\tcal clear - Remove the calibration points of the active scale\n"
+                        "\tcal gains - Show the gains and the calibration points\n";
+
+const char help_bench[] = "Measure the CPU cycles of a reading in float and in fixed point\n"
+                          "  Usage: bench\n";
+
+const char help_tasks[] = "Show the statistics of the scheduled tasks\n"
+                          "  Usage: tasks [reset]\n"
+                          "\tThe lateness is the delay from the release to the start, "
+                          "a deadline is missed when it's longer than the deadline of the task.\n";
+
+const char help_perf[] = "Show the execution time statistics of both cores\n"
+                         "  Usage: perf [reset]\n"
+                         "\tOnly available when built with PERF_ENABLED, see the pico_perf environment.\n";
+
+const char help_capture[] = "Stream the raw ADC blocks and the readings of both channels in binary over the serial port\n"
+                            "  Usage: capture [seconds]\n"
+                            "\tThe meters are restarted first, and the capture runs until anything is received. "
+                            "Save the serial output to a file and feed it to the replay of the native build.\n";
+
+const char help_stream[] = "Stream the samples of both channels in COBS framed binary over the serial port\n"
+                           "  Usage: stream <raw|filtered> [rate]\n"
+                           "\traw: the ADC codes of the U/I pairs, up to 20000 pairs per second\n"
+                           "\tfiltered: the readings in uV and uA, up to 100 per second\n"
+                           "\tThe rate in Hz is rounded to a whole fraction of the maximum. "
+                           "The stream runs until anything is received, see SampleStream.h for the frames.\n";
+
+const char help_fps[] = "Show the display refresh rate and the DMA flush times over the last second\n"
+                        "  Usage: fps\n"
+                        "\tThe waiting share is the time the rendering stalled for a flush to free a buffer, the sleeping share the idle time of the UI core.\n";
+
+const char help_heap[] = "Show the heap usage and the allocations made after the setup\n"
+                         "  Usage: heap\n"
+                         "\tThe firmware should not allocate once running, set HEAP_GUARD_PANIC in config.h to catch the first one.\n";
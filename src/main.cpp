@@ -1,42 +1,75 @@
 #include <Arduino.h>
-#include <EEPROM.h>
-#include <ulog.h>
 
+#include "AdcCorrection.h"
+#include "AdcSampler.h"
+#include "Benchmark.h"
+#include "CalFit.hpp"
+#include "Calibration.hpp"
+#include "Capture.h"
 #include "Console.h"
 #include "Display.h"
+#include "HeapGuard.h"
+#include "Journal.h"
 #include "KeyPad.hpp"
+#include "Log.h"
+#include "Meters.hpp"
+#include "Perf.h"
+#include "SampleStream.h"
+#include "Scpi.h"
+#include "Scheduler.h"
+#include "SerialTakeover.h"
+#include "Settings.h"
 #include "config.h"
-#include "VoltMeter.hpp"
+#include "FixedPoint.hpp"
 
-struct __attribute__((packed)) MeterSettings
+extern "C"
 {
-  uint8_t header; // Should be 0x69
-  float vScaleGains[4];
-  float iScaleGains[4];
+  extern const char help_cal[];
+  extern const char help_capture[];
+  extern const char help_fps[];
+  extern const char help_stream[];
+}
 
-  uint8_t checksum; // XOR of the payload bytes
-};
+// Thresholds in microvolts and microamps for the integer range comparison
+constexpr auto U_SCALE_MAX_UV = FixedPoint::toMicro(U_SCALE_MAX_VALUE);
+constexpr auto U_SCALE_MIN_UV = FixedPoint::toMicro(U_SCALE_MIN_VALUE);
+constexpr auto I_SCALE_MAX_UA = FixedPoint::toMicro(I_SCALE_MAX_VALUE);
+constexpr auto I_SCALE_MIN_UA = FixedPoint::toMicro(I_SCALE_MIN_VALUE);
+constexpr int32_t I_SAMPLE_RES_MOHM = I_SAMPLE_RES * 1000 + 0.5f;
 
-extern "C"
+/**
+ * @brief Convert the voltage across the sample resistor to the current
+ *
+ * @param value The voltage in microvolts, or a FixedPoint sentinel
+ * @return The current in microamps, or the sentinel
+ */
+static inline int32_t senseToCurrent(const int32_t value)
 {
-  extern const char help_cal[];
+  if (value == FixedPoint::INVALID || value == FixedPoint::OVERLOAD)
+    return value;
+  return value * 1000 / I_SAMPLE_RES_MOHM;
 }
 
 /**
- * @brief Calculate the sum of an byte (uint8_t) array by XOR
+ * @brief Apply the calibrations of all scales to a meter
  *
- * @param data A pointer to the byte array
- * @param len The length of the array
- * @return uint8_t sum
+ * @return false if any scale has no calibration point, nothing is applied then
  */
-inline uint8_t calcSum(const void *data, const std::size_t len)
+template <typename Meter>
+static bool applyCalibrations(Meter &meter, const ScaleCalibration (&cals)[4])
 {
-  uint8_t sum = 0;
-  for (std::size_t i = 0; i < len; i++)
+  for (uint8_t s = 0; s < 4; s++)
   {
-    sum ^= *(reinterpret_cast<const uint8_t *>(data) + i);
+    if (!cals[s].getCount())
+    {
+      ULOG_WARNING("Scale %d has no calibration point", s);
+      return false;
+    }
   }
-  return sum;
+
+  for (uint8_t s = 0; s < 4; s++)
+    meter.setCalibration(s, cals[s]);
+  return true;
 }
 
 /**
@@ -45,297 +78,557 @@ inline uint8_t calcSum(const void *data, const std::size_t len)
 void setup()
 {
   Console::init();
-  analogReadResolution(ADC_RESOLUTION);
-
-  VoltMeter uMeter(USENSE_PIN, U_SCALE0_PIN, U_SCALE1_PIN);
-  VoltMeter iMeter(ISENSE_PIN, I_SCALE0_PIN, I_SCALE1_PIN);
 
-  // Load the settings from "EEPROM"
-  MeterSettings settings;
-  EEPROM.begin(256);
-  EEPROM.get(0, settings);
-
-  auto sum = calcSum(&settings, sizeof(settings) - 1);
-  if (settings.header != 0x69 || sum != settings.checksum)
+  // Static since the sample buffers are too large for the stack
+  static UMeter uMeter(USENSE_PIN, U_SCALE0_PIN, U_SCALE1_PIN);
+  static IMeter iMeter(ISENSE_PIN, I_SCALE0_PIN, I_SCALE1_PIN);
+
+  // Load the settings from the flash journal, the calibrations are working copies while calibrating
+  ScaleCalibration uCals[4];
+  ScaleCalibration iCals[4];
+  int16_t spikeWidths[AdcCorrection::SPIKE_COUNT];
+  Journal::setEraseHooks(AdcSampler::pause, AdcSampler::resume);
+  Settings::load(uCals, iCals, spikeWidths);
+  for (uint8_t s = 0; s < 4; s++)
   {
-    ULOG_WARNING("No valid gain settings stored.");
-    memcpy(settings.vScaleGains, U_SCALE_DEF_GAINS, sizeof(U_SCALE_DEF_GAINS));
-    memcpy(settings.iScaleGains, I_SCALE_DEF_GAIN, sizeof(I_SCALE_DEF_GAIN));
+    uMeter.setCalibration(s, uCals[s]);
+    iMeter.setCalibration(s, iCals[s]);
   }
-  float vScaleGains[4];
-  float iScaleGains[4];
-  memcpy(vScaleGains, settings.vScaleGains, sizeof(vScaleGains));
-  memcpy(iScaleGains, settings.iScaleGains, sizeof(iScaleGains));
-  uMeter.setGains(vScaleGains);
-  iMeter.setGains(iScaleGains);
-
-  uint8_t calibrating = 0; // 0: not calibration, 1: voltage, 2: current
+  AdcCorrection::setSpikeWidths(spikeWidths);
+
+  uint8_t calibrating = 0; // 0: not calibration, 1: voltage, 2: current, 3: ADC linearity
+
+  // The reference points of "cal auto" on each scale, for the whole calibration
+  static LineFit uFits[4];
+  static LineFit iFits[4];
+  static PointCollector autoPoint;
+
+  // The calibration subcommands, sorted by name
+  static constexpr const char *CAL_MODES[]{"u", "i", "adc"};
+  static constexpr Console::ArgSpec CAL_START_ARGS[]{Console::ArgSpec::choice("mode", CAL_MODES)};
+  static constexpr Console::ArgSpec CAL_SCALE_ARGS[]{Console::ArgSpec::integer("scale level", 0, 3)};
+  static constexpr Console::ArgSpec CAL_IN_ARGS[]{Console::ArgSpec::real("value", 0, U_SCALE_MAX_VALUE[0])};
+  static constexpr Console::ArgSpec CAL_AUTO_ARGS[]{
+      Console::ArgSpec::real("value", 0, U_SCALE_MAX_VALUE[0]),
+      Console::ArgSpec::integer("samples", 10, CAL_AUTO_MAX_SAMPLES),
+  };
 
-  auto cmdCalCallback = [&settings, &calibrating, &uMeter, &iMeter](std::span<String> args)
+  // cal auto
+  auto cmdCalAuto = [&calibrating](Console::Args args)
   {
-    // cal start
-    if (args[1].equals("start"))
+    if (calibrating != 1 && calibrating != 2)
+    {
+      ULOG_WARNING("Not in voltage or current calibration mode");
+      return;
+    }
+    if (autoPoint.isActive())
     {
-      if (args.size() < 3)
+      ULOG_WARNING("Still collecting the previous point");
+      return;
+    }
+
+    auto inputValue = FixedPoint::toMicro(args[2].toFloat());
+    if (calibrating == 1)
+    {
+      autoPoint.scale = uMeter.getActiveScale();
+      autoPoint.value = inputValue;
+      if (inputValue > U_SCALE_MAX_UV[autoPoint.scale])
       {
-        ULOG_WARNING("Missing argument <u/i>");
+        ULOG_WARNING("Input value out of range");
         return;
       }
-
-      if (calibrating)
+    }
+    else
+    {
+      // The points hold the voltage across the sample resistor
+      autoPoint.scale = iMeter.getActiveScale();
+      autoPoint.value = inputValue * I_SAMPLE_RES_MOHM / 1000;
+      if (inputValue > I_SCALE_MAX_UA[autoPoint.scale])
       {
-        ULOG_WARNING("Calibration already started");
+        ULOG_WARNING("Input value out of range");
         return;
       }
+    }
 
-      if (args[2].equals("u"))
-      {
-        calibrating = 1;
-        ULOG_INFO("Voltage calibration started");
-      }
-      else if (args[2].equals("i"))
-      {
-        calibrating = 2;
-        ULOG_INFO("Current calibration started");
-      }
-      else
-      {
-        ULOG_WARNING("Invalid argument: %s", args[2].c_str());
-      }
+    uint32_t samples = args.size() == 4 ? args[3].toInt() : CAL_AUTO_DEF_SAMPLES;
+    autoPoint.start(samples);
+    ULOG_INFO("Collecting %u blocks on scale %d, keep the input steady", static_cast<unsigned>(samples), autoPoint.scale);
+  };
+
+  // Judge the point collected by cal auto, then fit its scale again with it
+  auto finishAutoPoint = [&uCals, &iCals, &calibrating]
+  {
+    bool voltage = calibrating == 1;
+    auto name = voltage ? "Voltage" : "Current";
+    auto unit = voltage ? "V" : "A";
+    double toInput = voltage ? 1 : 1000.0 / I_SAMPLE_RES_MOHM; // From the ADC input side to the input
+    auto scale = autoPoint.scale;
+
+    auto verdict = autoPoint.verdict(CAL_AUTO_MAX_NOISE_UV, CAL_AUTO_MAX_DRIFT_UV);
+    if (verdict != PointCollector::Verdict::SETTLED)
+    {
+      static constexpr const char *REASONS[]{"settled", "too noisy", "not settled", "overloaded"};
+      ULOG_WARNING("Point rejected, %s: noise %.1f uV, drift %.1f uV at the ADC pin",
+                   REASONS[static_cast<uint8_t>(verdict)], autoPoint.noise(), autoPoint.drift());
       return;
     }
 
-    // cal save
-    if (args[1].equals("save"))
+    auto &fit = (voltage ? uFits : iFits)[scale];
+    auto index = fit.addPoint({autoPoint.mean(), static_cast<double>(autoPoint.value),
+                               autoPoint.noise() / std::sqrt(autoPoint.count())});
+    ULOG_INFO("%s scale %d point %d: %.1f uV, noise %.1f uV, drift %.1f uV", name, scale, index,
+              autoPoint.mean(), autoPoint.noise(), autoPoint.drift());
+
+    auto result = fit.fit();
+    if (!fit.apply(result, (voltage ? uCals : iCals)[scale]))
     {
-      float gains[4];
-      switch (calibrating)
-      {
-      case 1: // U
-        memcpy(gains, settings.vScaleGains, sizeof(vScaleGains));
-        uMeter.setGains(gains);
-        break;
-
-      case 2: // I
-        memcpy(gains, settings.iScaleGains, sizeof(iScaleGains));
-        iMeter.setGains(gains);
-        break;
-
-      default:
-        ULOG_WARNING("Not in calibration mode");
-        return;
-      }
+      ULOG_WARNING("Unable to fit scale %d, the points should have different values", scale);
+      return;
+    }
 
-      calibrating = 0;
-      settings.header = 0x69;
-      settings.checksum = calcSum(&settings, sizeof(settings) - 1);
-      EEPROM.put(0, settings);
-      EEPROM.commit();
-      ULOG_INFO("Calibration data saved");
+    ULOG_INFO("%s scale %d fit over %d point(s): gain %.5f, offset %.1f uV", name, scale, result.count,
+              result.gain, result.offset);
+    double top = 0;
+    for (uint8_t i = 0; i < fit.getCount(); i++)
+    {
+      auto &point = fit.getPoint(i);
+      top = std::max(top, point.value);
+      ULOG_INFO("  %.6f %s: residual %.1f u%s", point.value * toInput / 1e6, unit,
+                fit.residual(i, result) / result.gain * toInput, unit);
+    }
+    auto uncertainty = fit.uncertainty(top, result);
+    ULOG_INFO("Uncertainty (1 sigma): %.1f u%s, %.1f ppm at %.6f %s", uncertainty * toInput, unit,
+              top ? uncertainty / top * 1e6 : 0.0, top * toInput / 1e6, unit);
+  };
+
+  // cal clear
+  auto cmdCalClear = [&uCals, &iCals, &calibrating](Console::Args args)
+  {
+    switch (calibrating)
+    {
+    case 1: // U
+      autoPoint.cancel();
+      uCals[uMeter.getActiveScale()].clear();
+      uFits[uMeter.getActiveScale()].clear();
+      ULOG_INFO("Voltage scale %d points cleared", uMeter.getActiveScale());
+      return;
+
+    case 2: // I
+      autoPoint.cancel();
+      iCals[iMeter.getActiveScale()].clear();
+      iFits[iMeter.getActiveScale()].clear();
+      ULOG_INFO("Current scale %d points cleared", iMeter.getActiveScale());
+      return;
+
+    default:
+      ULOG_WARNING("Not in calibration mode");
       return;
     }
+  };
 
-    // cal exit
-    if (args[1].equals("exit"))
+  // cal exit
+  auto cmdCalExit = [&uCals, &iCals, &calibrating](Console::Args args)
+  {
+    if (!calibrating)
     {
-      if (!calibrating)
-      {
-        ULOG_WARNING("Not in calibration mode");
-        return;
-      }
-      calibrating = 0;
-      ULOG_INFO("Calibration canceled");
+      ULOG_WARNING("Not in calibration mode");
       return;
     }
+    for (uint8_t s = 0; s < 4; s++)
+    {
+      uCals[s] = uMeter.getCalibration(s);
+      iCals[s] = iMeter.getCalibration(s);
+    }
+    autoPoint.cancel();
+    calibrating = 0;
+    uMeter.setAutoRange(true);
+    iMeter.setAutoRange(true);
+    ULOG_INFO("Calibration canceled");
+  };
 
-    // cal scale
-    if (args[1].equals("scale"))
+  // cal gains
+  auto cmdCalGains = [&uCals, &iCals, &spikeWidths](Console::Args args)
+  {
+    auto printCals = [](const char *name, const ScaleCalibration (&cals)[4])
     {
-      switch (calibrating)
+      for (uint8_t s = 0; s < 4; s++)
       {
-      case 1: // U
-      {
-        if (args.size() == 3)
-        {
-          auto scale = args[2].toInt();
-          if (scale < 0 || scale > 3)
-          {
-            ULOG_WARNING("Invalid scale level");
-            return;
-          }
-          uMeter.selectScale(scale);
-        }
-        auto activeScale = uMeter.getActiveScale();
-        ULOG_INFO("Voltage scale: %d, range: %.2fV - %.2fV",
-                  activeScale, U_SCALE_MIN_VALUE[activeScale], U_SCALE_MAX_VALUE[activeScale]);
-        return;
+        ULOG_INFO("%s scale %d gain: %.4f, %d point(s)", name, s,
+                  static_cast<float>(cals[s].gain()) / FixedPoint::ONE, cals[s].getCount());
+        for (uint8_t i = 0; i < cals[s].getCount(); i++)
+          ULOG_INFO("  %u uV -> %d uV", cals[s].getPoint(i).raw, static_cast<int>(cals[s].getPoint(i).value));
       }
-      case 2: // I
+    };
+
+    printCals("Voltage", uCals);
+    printCals("Current", iCals);
+    ULOG_INFO("ADC wide code widths: %d %d %d %d (1/16 LSB)", spikeWidths[0], spikeWidths[1],
+              spikeWidths[2], spikeWidths[3]);
+  };
+
+  // cal in
+  auto cmdCalIn = [&uCals, &iCals, &calibrating](Console::Args args)
+  {
+    auto inputValue = FixedPoint::toMicro(args[2].toFloat());
+
+    switch (calibrating)
+    {
+    case 1: // U
+    {
+      auto activeScale = uMeter.getActiveScale();
+      if (inputValue > U_SCALE_MAX_UV[activeScale])
       {
-        if (args.size() == 3)
-        {
-          auto scale = args[2].toInt();
-          if (scale < 0 || scale > 3)
-          {
-            ULOG_WARNING("Invalid scale level");
-            return;
-          }
-          iMeter.selectScale(scale);
-        }
-        auto activeScale = iMeter.getActiveScale();
-        ULOG_INFO("Current scale: %d, range: %.2fA - %.2fA",
-                  activeScale, I_SCALE_MIN_VALUE[activeScale], I_SCALE_MAX_VALUE[activeScale]);
-        return;
-      }
-      default:
-        ULOG_WARNING("Not in calibration mode");
+        ULOG_WARNING("Input value out of range");
         return;
       }
+
+      auto rawV = uMeter.getRawVoltage();
+      auto index = uCals[activeScale].addPoint(rawV, inputValue);
+      ULOG_INFO("Voltage scale %d point %d: %u uV -> %d uV, gain: %.4f", activeScale, index, rawV,
+                static_cast<int>(inputValue), static_cast<float>(uCals[activeScale].gain()) / FixedPoint::ONE);
+      return;
     }
 
-    // cal in
-    if (args[1].equals("in"))
+    case 2: // I
     {
-      auto inputValue = args[2].toFloat();
-
-      switch (calibrating)
-      {
-      case 1: // U
+      auto activeScale = iMeter.getActiveScale();
+      if (inputValue > I_SCALE_MAX_UA[activeScale])
       {
-        auto activeScale = uMeter.getActiveScale();
-        if (inputValue < U_SCALE_MIN_VALUE[activeScale] || inputValue > U_SCALE_MAX_VALUE[activeScale])
-        {
-          ULOG_WARNING("Input value out of range");
-          return;
-        }
-
-        auto rawV = uMeter.getRawVoltage();
-        auto gain = rawV / inputValue;
-        settings.vScaleGains[activeScale] = gain;
-        ULOG_INFO("Voltage scale %d gain: %.4f", activeScale, gain);
+        ULOG_WARNING("Input value out of range");
         return;
       }
 
-      case 2: // I
-      {
-        auto activeScale = iMeter.getActiveScale();
-        if (inputValue < I_SCALE_MIN_VALUE[activeScale] || inputValue > I_SCALE_MAX_VALUE[activeScale])
-        {
-          ULOG_WARNING("Input value out of range");
-          return;
-        }
-
-        auto rawV = iMeter.getRawVoltage();
-        auto gain = rawV / (inputValue * I_SAMPLE_RES);
-        settings.iScaleGains[activeScale] = gain;
-        ULOG_INFO("Current scale %d gain: %.4f", activeScale, gain);
+      // The points hold the voltage across the sample resistor
+      auto rawV = iMeter.getRawVoltage();
+      auto index = iCals[activeScale].addPoint(rawV, inputValue * I_SAMPLE_RES_MOHM / 1000);
+      ULOG_INFO("Current scale %d point %d: %u uV -> %d uA, gain: %.4f", activeScale, index, rawV,
+                static_cast<int>(inputValue), static_cast<float>(iCals[activeScale].gain()) / FixedPoint::ONE);
+      return;
+    }
+
+    default:
+      ULOG_WARNING("Not in calibration mode");
+      return;
+    }
+  };
+
+  // cal save
+  auto cmdCalSave = [&uCals, &iCals, &spikeWidths, &calibrating](Console::Args args)
+  {
+    switch (calibrating)
+    {
+    case 1: // U
+      if (!applyCalibrations(uMeter, uCals))
         return;
-      }
+      break;
+
+    case 2: // I
+      if (!applyCalibrations(iMeter, iCals))
+        return;
+      break;
 
-      default:
-        ULOG_WARNING("Not in calibration mode");
+    case 3: // ADC
+    {
+      int16_t widths[AdcCorrection::SPIKE_COUNT];
+      if (!AdcCorrection::finishCapture(widths))
         return;
+
+      memcpy(spikeWidths, widths, sizeof(widths));
+      AdcCorrection::setSpikeWidths(widths);
+      ULOG_INFO("ADC wide code widths: %d %d %d %d (1/16 LSB)", widths[0], widths[1], widths[2], widths[3]);
+      break;
+    }
+
+    default:
+      ULOG_WARNING("Not in calibration mode");
+      return;
+    }
+
+    autoPoint.cancel();
+    calibrating = 0;
+    uMeter.setAutoRange(true);
+    iMeter.setAutoRange(true);
+    if (Settings::save(uCals, iCals, spikeWidths))
+      ULOG_INFO("Calibration data saved");
+  };
+
+  // cal scale
+  auto cmdCalScale = [&calibrating](Console::Args args)
+  {
+    switch (calibrating)
+    {
+    case 1: // U
+    {
+      if (args.size() == 3)
+      {
+        autoPoint.cancel();
+        uMeter.selectScale(args[2].toInt());
+      }
+      auto activeScale = uMeter.getActiveScale();
+      ULOG_INFO("Voltage scale: %d, range: %.2fV - %.2fV",
+                activeScale, U_SCALE_MIN_VALUE[activeScale], U_SCALE_MAX_VALUE[activeScale]);
+      return;
+    }
+    case 2: // I
+    {
+      if (args.size() == 3)
+      {
+        autoPoint.cancel();
+        iMeter.selectScale(args[2].toInt());
       }
+      auto activeScale = iMeter.getActiveScale();
+      ULOG_INFO("Current scale: %d, range: %.2fA - %.2fA",
+                activeScale, I_SCALE_MIN_VALUE[activeScale], I_SCALE_MAX_VALUE[activeScale]);
+      return;
+    }
+    default:
+      ULOG_WARNING("Not in calibration mode");
+      return;
     }
+  };
 
-    // cal gains
-    if (args[1].equals("gains"))
+  // cal start
+  auto cmdCalStart = [&calibrating](Console::Args args)
+  {
+    if (calibrating)
     {
-      ULOG_INFO("Voltage gains: %.4f %.4f %.4f %.4f", settings.vScaleGains[0], settings.vScaleGains[1], settings.vScaleGains[2], settings.vScaleGains[3]);
-      ULOG_INFO("Current gains: %.4f %.4f %.4f %.4f", settings.iScaleGains[0], settings.iScaleGains[1], settings.iScaleGains[2], settings.iScaleGains[3]);
+      ULOG_WARNING("Calibration already started");
       return;
     }
+
+    for (uint8_t s = 0; s < 4; s++)
+    {
+      uFits[s].clear();
+      iFits[s].clear();
+    }
+
+    switch (args[2].getChoice())
+    {
+    case 0: // u
+      calibrating = 1;
+      uMeter.setAutoRange(false);
+      ULOG_INFO("Voltage calibration started");
+      break;
+
+    case 1: // i
+      calibrating = 2;
+      iMeter.setAutoRange(false);
+      ULOG_INFO("Current calibration started");
+      break;
+
+    default: // adc
+      calibrating = 3;
+      uMeter.setAutoRange(false);
+      AdcCorrection::startCapture();
+      ULOG_INFO("ADC linearity capture started, apply a slow ramp covering the full scale to the voltage input");
+      break;
+    }
   };
 
-  Console::Command calCmd{"cal", help_cal, 1, 2, cmdCalCallback};
+  // Referenced by the command, lives as long as setup() since Scheduler::run() doesn't return
+  const Console::Command calSubcommands[]{
+      {"auto", nullptr, 1, 2, cmdCalAuto, CAL_AUTO_ARGS},
+      {"clear", nullptr, 0, 0, cmdCalClear},
+      {"exit", nullptr, 0, 0, cmdCalExit},
+      {"gains", nullptr, 0, 0, cmdCalGains},
+      {"in", nullptr, 1, 1, cmdCalIn, CAL_IN_ARGS},
+      {"save", nullptr, 0, 0, cmdCalSave},
+      {"scale", nullptr, 0, 1, cmdCalScale, CAL_SCALE_ARGS},
+      {"start", nullptr, 1, 1, cmdCalStart, CAL_START_ARGS},
+  };
+
+  Console::Command calCmd{"cal", help_cal, 0, 0, {}, {}, calSubcommands};
   Console::registerCommand(calCmd);
 
-  while (1)
+  auto cmdCaptureCallback = [&calibrating, &spikeWidths](Console::Args args)
   {
-    auto time0 = millis();
+    if (calibrating)
+    {
+      ULOG_WARNING("Not available in calibration mode");
+      return;
+    }
+    if (SampleStream::isActive())
+    {
+      ULOG_WARNING("Not available while streaming");
+      return;
+    }
+
+    uint32_t seconds = args.size() == 2 ? args[1].toInt() : 0;
 
-    if (!(millis() % SAMPLE_PERIOD))
+    // Restart the meters, so the replay starts from the same state
+    uMeter.restart();
+    iMeter.restart();
+
+    ScaleCalibration uCals[4];
+    ScaleCalibration iCals[4];
+    for (uint8_t s = 0; s < 4; s++)
     {
-      uMeter.convertOnce();
-      iMeter.convertOnce();
+      uCals[s] = uMeter.getCalibration(s);
+      iCals[s] = iMeter.getCalibration(s);
     }
 
-    if (!(millis() % GET_VALUE_PERIOD))
+    Capture::Header header{};
+    header.uScale = uMeter.getActiveScale();
+    header.iScale = iMeter.getActiveScale();
+    header.flags = (uMeter.getAutoRange() ? Capture::U_AUTO_RANGE : 0) | (iMeter.getAutoRange() ? Capture::I_AUTO_RANGE : 0);
+    memcpy(header.spikeWidths, spikeWidths, sizeof(header.spikeWidths));
+    Capture::setCalibrations(header, uCals, iCals);
+
+    ULOG_INFO("Capture started, send anything to stop");
+    Capture::start(header, seconds * ADC_SAMPLE_RATE / ADC_BLOCK_SIZE);
+  };
+
+  static constexpr Console::ArgSpec CAPTURE_ARGS[]{Console::ArgSpec::integer("duration", 1, 24 * 3600)};
+  Console::Command captureCmd{"capture", help_capture, 0, 1, cmdCaptureCallback, CAPTURE_ARGS};
+  Console::registerCommand(captureCmd);
+
+  auto cmdStreamCallback = [&calibrating](Console::Args args)
+  {
+    if (calibrating)
+    {
+      ULOG_WARNING("Not available in calibration mode");
+      return;
+    }
+    if (Capture::isActive())
     {
-      auto uValue = uMeter.readVoltage();
-      auto iValue = iMeter.readVoltage();
-      iValue /= I_SAMPLE_RES;
+      ULOG_WARNING("Not available while capturing");
+      return;
+    }
 
-      // Scale auto-adjustment and overload detection when not in calibration mode
-      if (calibrating == 1)
-      {
-        uValue = -1;
-      }
-      else if (uValue >= 0) // Voltage is valid and not in calibration mode
-      {
-        auto activeScale = uMeter.getActiveScale();
-        if (uValue > U_SCALE_MAX_VALUE[activeScale]) // Too high
-        {
-          if (activeScale > 0)
-          {
-            uMeter.selectScale(activeScale - 1);
-            uValue = -1; // Invalidate the value
-          }
-          else
-          {
-            uValue = INFINITY; // Overload
-          }
-        }
-        else if (uValue < U_SCALE_MIN_VALUE[activeScale]) // Too low
-        {
-          if (activeScale < 3)
-          {
-            uMeter.selectScale(activeScale + 1);
-          }
-        }
-      }
+    auto mode = args[1].getChoice() ? SampleStream::Mode::FILTERED : SampleStream::Mode::RAW;
+    uint32_t maxRate = mode == SampleStream::Mode::RAW ? SampleStream::CHANNEL_RATE
+                                                       : ADC_SAMPLE_RATE / ADC_BLOCK_SIZE; // A reading per block
 
-      if (calibrating == 2)
-      {
-        iValue = -1;
-      }
-      else if (iValue >= 0) // Current is valid and not in calibration mode
+    uint32_t rate = maxRate;
+    if (args.size() == 3)
+    {
+      rate = args[2].toInt();
+      if (rate > maxRate)
       {
-        auto activeScale = iMeter.getActiveScale();
-        if (iValue > I_SCALE_MAX_VALUE[activeScale]) // Too high
-        {
-          if (activeScale > 0)
-          {
-            iMeter.selectScale(activeScale - 1);
-            iValue = -1; // Invalidate the value
-          }
-          else
-          {
-            iValue = INFINITY; // Overload
-          }
-        }
-        else if (iValue < I_SCALE_MIN_VALUE[activeScale]) // Too low
-        {
-          if (activeScale < 3)
-          {
-            iMeter.selectScale(activeScale + 1);
-          }
-        }
+        ULOG_WARNING("Invalid rate: %s, 1 to %u Hz", args[2].c_str(), static_cast<unsigned>(maxRate));
+        return;
       }
+    }
+
+    // The rate is a whole fraction of the maximum
+    auto divider = (maxRate + rate / 2) / rate;
+    ULOG_INFO("Streaming at %u.%03u Hz, send anything to stop", static_cast<unsigned>(maxRate / divider),
+              static_cast<unsigned>(maxRate % divider * 1000 / divider));
+    SampleStream::start(mode, divider);
+  };
+
+  static constexpr const char *STREAM_MODES[]{"raw", "filtered"};
+  static constexpr Console::ArgSpec STREAM_ARGS[]{
+      Console::ArgSpec::choice("mode", STREAM_MODES),
+      Console::ArgSpec::integer("rate", 1, SampleStream::CHANNEL_RATE),
+  };
+  Console::Command streamCmd{"stream", help_stream, 1, 2, cmdStreamCallback, STREAM_ARGS};
+  Console::registerCommand(streamCmd);
+
+  auto cmdFpsCallback = [](Console::Args args)
+  {
+    auto stats = Display::getFrameStats();
+    ULOG_INFO("%u.%u fps, flush avg %u us, max %u us, waiting for flushes %u.%u%%, sleeping %u.%u%%",
+              static_cast<unsigned>(stats.fps10 / 10), static_cast<unsigned>(stats.fps10 % 10),
+              static_cast<unsigned>(stats.avgFlushUs), static_cast<unsigned>(stats.maxFlushUs),
+              static_cast<unsigned>(stats.waitPermille / 10), static_cast<unsigned>(stats.waitPermille % 10),
+              static_cast<unsigned>(stats.sleepPermille / 10), static_cast<unsigned>(stats.sleepPermille % 10));
+  };
 
-      ULOG_DEBUG("Voltage: %f V (%d), Current: %f A (%d)", uValue, uMeter.getActiveScale(), iValue, iMeter.getActiveScale());
-      Display::updateVoltage(uValue);
-      Display::updateCurrent(iValue);
+  Console::Command fpsCmd{"fps", help_fps, 0, 0, cmdFpsCallback};
+  Console::registerCommand(fpsCmd);
+
+  // The scales of the SCPI remote control, not while calibrating since the calibration selects them
+  auto getRange = [](Scpi::Channel channel) -> Scpi::Range
+  {
+    if (channel == Scpi::Channel::VOLTAGE)
+      return {uMeter.getActiveScale(), uMeter.getAutoRange()};
+    return {iMeter.getActiveScale(), iMeter.getAutoRange()};
+  };
+  auto setRange = [&calibrating](Scpi::Channel channel, int8_t scale)
+  {
+    if (calibrating)
+      return false;
+
+    auto apply = [scale](auto &meter)
+    {
+      meter.setAutoRange(scale == Scpi::AUTO_RANGE);
+      if (scale != Scpi::AUTO_RANGE)
+        meter.selectScale(scale);
+    };
+    if (channel == Scpi::Channel::VOLTAGE)
+      apply(uMeter);
+    else
+      apply(iMeter);
+    return true;
+  };
+  Scpi::init(getRange, setRange);
+
+  Benchmark::init();
+  Perf::init();
+  HeapGuard::init();
+  Scheduler::init();
+
+  auto sampleTask = [&calibrating, &finishAutoPoint]
+  {
+    PERF_SCOPE(SAMPLE);
+    for (auto block = AdcSampler::getBlock(); !block.empty(); block = AdcSampler::getBlock())
+    {
+      auto uScale = uMeter.getActiveScale();
+      auto iScale = iMeter.getActiveScale();
+      uMeter.convertBlock(block, AdcSampler::CHANNEL_COUNT);
+      iMeter.convertBlock(block, AdcSampler::CHANNEL_COUNT);
+      if (autoPoint.pushBlock(block, (calibrating == 1 ? USENSE_PIN : ISENSE_PIN) - 26, AdcSampler::CHANNEL_COUNT))
+        finishAutoPoint();
+      if (calibrating == 3)
+        AdcCorrection::feedCapture(block, USENSE_PIN - 26, AdcSampler::CHANNEL_COUNT);
+      if (Capture::isActive())
+        Capture::writeBlock(block, uScale, iScale, uMeter.readVoltage(), iMeter.readVoltage());
+      if (SampleStream::isActive())
+        SampleStream::writeBlock(block, uScale, iScale, {uMeter.readVoltage(), senseToCurrent(iMeter.readVoltage())});
     }
+  };
+
+  auto valueTask = [&calibrating]
+  {
+    PERF_SCOPE(VALUE);
+    // The scales are selected in VoltMeter::convertBlock(), except in calibration mode
+    auto uValue = (calibrating == 1 || calibrating == 3) ? FixedPoint::INVALID : uMeter.readVoltage();
+    auto iValue = calibrating == 2 ? FixedPoint::INVALID : senseToCurrent(iMeter.readVoltage());
 
-    if (!(millis() % CONSOLE_HANDLE_PERIOD))
     {
-      Console::handleConsoleEvent();
+      PERF_SCOPE(LOG);
+      ULOG_DEBUG("Voltage: %d uV (%d), Current: %d uA (%d), display queue overflows: %u",
+                 static_cast<int>(uValue), uMeter.getActiveScale(), static_cast<int>(iValue), iMeter.getActiveScale(),
+                 static_cast<unsigned>(Display::getQueueOverflows()));
     }
+    Scpi::pushReading(uValue, iValue);
+    Display::pushMeasurement({
+        .timestamp = time_us_32(),
+        .voltage = uValue,
+        .current = iValue,
+        .uScale = uMeter.getActiveScale(),
+        .iScale = iMeter.getActiveScale(),
+    });
+  };
 
-    while (millis() == time0)
-      ;
-  }
+  auto consoleTask = []
+  {
+    PERF_SCOPE(CONSOLE);
+    if (!SerialTakeover::isActive()) // The serial port carries the binary data
+      Console::handleConsoleEvent();
+    Log::drain(); // Muted while capturing, the records are dropped then
+  };
+
+  Scheduler::addTask("sample", SAMPLE_TASK_PERIOD * 1000, sampleTask);
+  // Skipped when late, a catch-up would push the same filter reading again to the history and the SCPI averaging
+  Scheduler::addTask("value", GET_VALUE_PERIOD * 1000, valueTask, Scheduler::Policy::SKIP);
+  Scheduler::addTask("console", CONSOLE_HANDLE_PERIOD * 1000, consoleTask);
+  Scheduler::addTask("heap", HEAP_CHECK_PERIOD * 1000, HeapGuard::check);
+
+  AdcSampler::init(ADC_SAMPLE_RATE);
+  HeapGuard::setupDone();
+  Scheduler::run();
 }
 
 // Useless
@@ -346,35 +639,44 @@ void loop()
 // For UI driver
 void setup1()
 {
-  KeyPad keyPad;
+  // Static since the scan interrupt refers to it
+  static KeyPad keyPad;
   keyPad.addKey(KEY_R_PIN);
   keyPad.addKey(KEY_L_PIN);
   keyPad.addKey(KEY_OK_PIN);
+  keyPad.setOnChange(Display::notifyKeyEvent);
 
-  auto readKey = [&keyPad] -> std::pair<uint32_t, bool>
+  auto readKey = [](Display::KeyInput &input)
   {
-    auto [k, s] = keyPad.getLastKeyEvent();
-    uint32_t keyID;
-    switch (k)
+    KeyPad::Event event;
+    if (!keyPad.popEvent(event))
+      return false;
+
+    switch (event.key)
     {
     case KEY_R_PIN:
-      keyID = Display::LV_KEY_NEXT;
+      input.key = Display::LV_KEY_NEXT;
       break;
     case KEY_L_PIN:
-      keyID = Display::LV_KEY_PREV;
+      input.key = Display::LV_KEY_PREV;
       break;
     case KEY_OK_PIN:
-      keyID = Display::LV_KEY_ENTER;
+      input.key = Display::LV_KEY_ENTER;
       break;
     default:
-      keyID = 0;
+      input.key = 0;
     }
 
-    return {keyID, s};
+    // The long presses and the repeats keep the key pressed for LVGL
+    input.pressed = event.type != KeyPad::EventType::RELEASE;
+    input.more = keyPad.hasEvents();
+    return true;
   };
 
   Display::init();
   Display::setReadKeyEventCb(readKey);
+  keyPad.begin();
+  HeapGuard::setupDone();
 
   while (true)
   {
@@ -0,0 +1,66 @@
+#include "AdcSampler.h"
+#include "Mock.h"
+#include "config.h"
+
+// Mock ADC, the blocks are generated from the sample source on demand
+namespace AdcSampler
+{
+    static uint16_t block[ADC_BLOCK_SIZE];
+    static uint32_t pendingBlocks = 0;
+    static uint32_t sampleIndex = 0;
+    static Mock::AdcSource source;
+
+    void init(const uint32_t sampleRate)
+    {
+        sampleIndex = 0;
+    }
+
+    std::span<const uint16_t> getBlock()
+    {
+        if (!pendingBlocks)
+            return {};
+
+        pendingBlocks--;
+        for (uint32_t i = 0; i < ADC_BLOCK_SIZE; i++)
+        {
+            // Round-robin, the channel number is the position in the block
+            block[i] = source ? source(i % CHANNEL_COUNT, sampleIndex) : 0;
+            sampleIndex += (i % CHANNEL_COUNT == CHANNEL_COUNT - 1);
+        }
+        return {block, ADC_BLOCK_SIZE};
+    }
+
+    uint32_t getSamplesAhead()
+    {
+        // The blocks are generated when they're taken
+        return 0;
+    }
+
+    uint32_t getDroppedBlocks()
+    {
+        return 0;
+    }
+
+    void pause()
+    {
+    }
+
+    void resume()
+    {
+    }
+
+} // namespace AdcSampler
+
+namespace Mock
+{
+    void setAdcSource(AdcSource source)
+    {
+        AdcSampler::source = std::move(source);
+    }
+
+    void queueAdcBlocks(const uint32_t count)
+    {
+        AdcSampler::pendingBlocks += count;
+    }
+
+} // namespace Mock
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "Hal.h"
+#include "Mock.h"
+
+namespace
+{
+    struct Timer
+    {
+        uint32_t periodUs;
+        uint32_t dueUs;
+        Hal::TimerCb cb;
+        void *param;
+    };
+
+    uint32_t pinLevels = 0;
+    uint32_t now = 0;
+    std::vector<Timer> timers;
+
+    std::deque<char> serialInput;
+    std::string serialOutput;
+
+    // Erased flash reads as 0xFF
+    std::vector<uint8_t> storage(4 * Hal::STORAGE_SECTOR_SIZE, 0xFF);
+    std::vector<uint8_t> legacyStorage(Hal::STORAGE_SECTOR_SIZE, 0xFF);
+} // namespace
+
+namespace Hal
+{
+    void pinOutput(const uint32_t pin)
+    {
+    }
+
+    void pinInput(const uint32_t pin, const bool pullUp)
+    {
+        Mock::setPinLevel(pin, pullUp);
+    }
+
+    bool pinRead(const uint32_t pin)
+    {
+        return pinLevels & (1ul << pin);
+    }
+
+    void pinsPut(const uint32_t mask, const uint32_t value)
+    {
+        pinLevels = (pinLevels & ~mask) | (value & mask);
+    }
+
+    uint32_t millis()
+    {
+        return now;
+    }
+
+    uint32_t micros()
+    {
+        return now * 1000;
+    }
+
+    bool startTimer(const uint32_t periodUs, TimerCb cb, void *param)
+    {
+        timers.push_back({periodUs, now * 1000 + periodUs, cb, param});
+        return true;
+    }
+
+    uint8_t coreNum()
+    {
+        return 0;
+    }
+
+    uint32_t interruptsOff()
+    {
+        return 0;
+    }
+
+    void interruptsRestore(const uint32_t state)
+    {
+    }
+
+    void serialBegin(const uint32_t baudRate)
+    {
+    }
+
+    int serialRead()
+    {
+        if (serialInput.empty())
+            return -1;
+
+        char c = serialInput.front();
+        serialInput.pop_front();
+        return static_cast<uint8_t>(c);
+    }
+
+    std::size_t serialAvailableForWrite()
+    {
+        return SIZE_MAX;
+    }
+
+    void serialWrite(const char *data, const std::size_t len)
+    {
+        serialOutput.append(data, len);
+    }
+
+    void serialWrite(const char *str)
+    {
+        serialOutput.append(str);
+    }
+
+    void serialPrintf(const char *fmt, ...)
+    {
+        char buf[256];
+        va_list args;
+        va_start(args, fmt);
+        auto len = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (len > 0)
+            serialOutput.append(buf, std::min<std::size_t>(len, sizeof(buf) - 1));
+    }
+
+    std::span<const uint8_t> storageArea()
+    {
+        return storage;
+    }
+
+    void storageErase(const std::size_t sector)
+    {
+        std::fill_n(storage.begin() + sector * STORAGE_SECTOR_SIZE, STORAGE_SECTOR_SIZE, 0xFF);
+    }
+
+    void storageProgram(const std::size_t page, const uint8_t *data)
+    {
+        // Programming only clears bits, like the flash
+        for (std::size_t i = 0; i < STORAGE_PAGE_SIZE; i++)
+            storage[page * STORAGE_PAGE_SIZE + i] &= data[i];
+    }
+
+    std::span<const uint8_t> legacyStorageArea()
+    {
+        return legacyStorage;
+    }
+
+} // namespace Hal
+
+namespace Mock
+{
+    uint32_t getPinLevels()
+    {
+        return pinLevels;
+    }
+
+    void setPinLevel(const uint32_t pin, const bool level)
+    {
+        Hal::pinsPut(1ul << pin, level ? 1ul << pin : 0);
+    }
+
+    void advanceMillis(const uint32_t ms)
+    {
+        // A millisecond at a time, firing the timers due meanwhile in order
+        for (uint32_t i = 0; i < ms; i++)
+        {
+            now++;
+            for (auto &timer : timers)
+            {
+                for (; static_cast<int32_t>(now * 1000 - timer.dueUs) >= 0; timer.dueUs += timer.periodUs)
+                    timer.cb(timer.param);
+            }
+        }
+    }
+
+    void feedSerial(std::string_view input)
+    {
+        serialInput.insert(serialInput.end(), input.begin(), input.end());
+    }
+
+    std::string takeSerialOutput()
+    {
+        return std::exchange(serialOutput, {});
+    }
+
+    const uint8_t *getStorage()
+    {
+        return storage.data();
+    }
+
+} // namespace Mock
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * Controls of the mocked hardware in the native environment
+ */
+namespace Mock
+{
+    /** Sample source of the mock ADC: input number and sample index to the raw code */
+    using AdcSource = std::function<uint16_t(uint8_t input, uint32_t index)>;
+
+    void setAdcSource(AdcSource source);
+
+    /**
+     * @brief Make some blocks available to AdcSampler::getBlock()
+     *
+     * @param count The number of blocks
+     */
+    void queueAdcBlocks(const uint32_t count);
+
+    /** Levels of the output pins, one bit per pin */
+    uint32_t getPinLevels();
+
+    void setPinLevel(const uint32_t pin, const bool level);
+
+    /** Advance the time, running the timers of Hal::startTimer() */
+    void advanceMillis(const uint32_t ms);
+
+    void feedSerial(std::string_view input);
+
+    /** Take what was written to the serial port since the last call */
+    std::string takeSerialOutput();
+
+    /** The storage area content */
+    const uint8_t *getStorage();
+
+} // namespace Mock
@@ -0,0 +1,124 @@
+// Host microbenchmarks of the hot paths
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+
+#include "AdcCorrection.h"
+#include "AdcSampler.h"
+#include "Calibration.hpp"
+#include "Console.h"
+#include "Filters.hpp"
+#include "FixedPoint.hpp"
+#include "Meters.hpp"
+#include "Mock.h"
+#include "config.h"
+
+constexpr uint32_t BENCH_SAMPLES = 4000000;
+
+static volatile uint32_t sink;
+
+/**
+ * @brief Run a function repeatedly and print the time per iteration
+ *
+ * @param name The benchmark name
+ * @param iterations How many times the function is run
+ * @param fn The function, taking the iteration index
+ */
+template <typename Fn>
+static void bench(const char *name, const uint32_t iterations, Fn &&fn)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        fn(i);
+    auto t1 = std::chrono::steady_clock::now();
+    auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    printf("%-28s %8.2f ns/sample\n", name, ns / iterations);
+}
+
+static uint16_t testCodes[1 << 16];
+
+/** A slowly varying ADC code with some noise, from a table so the generation isn't timed */
+static inline uint16_t testCode(const uint32_t i)
+{
+    return testCodes[i & (std::size(testCodes) - 1)];
+}
+
+template <typename F>
+static void benchFilter(const char *name)
+{
+    static F filter;
+    bench(name, BENCH_SAMPLES, [](uint32_t i)
+          {
+              filter.push(testCode(i));
+              sink = filter.mean(); });
+}
+
+int runBenchmarks()
+{
+    for (uint32_t i = 0; i < std::size(testCodes); i++)
+        testCodes[i] = 2000 + 1500 * std::sin(i * 2 * M_PI / std::size(testCodes)) + (i * 2654435761u >> 29);
+
+    benchFilter<BoxcarFilter<U_FILTER_SAMPLES>>("BoxcarFilter push+mean");
+    benchFilter<EmaFilter<I_FILTER_SAMPLES>>("EmaFilter push+mean");
+    benchFilter<CicFilter<64>>("CicFilter push+mean");
+    benchFilter<MedianFilter<16>>("MedianFilter push+mean");
+
+    int16_t widths[AdcCorrection::SPIKE_COUNT]{16, 24, 8, 32};
+    AdcCorrection::setSpikeWidths(widths);
+    bench("AdcCorrection::apply", BENCH_SAMPLES, [](uint32_t i)
+          { sink = AdcCorrection::apply(testCode(i)); });
+
+    ScaleCalibration cal;
+    cal.addPoint(20000, 0);
+    cal.addPoint(1500000, 6500000);
+    cal.addPoint(3000000, 13100000);
+    bench("ScaleCalibration::apply", BENCH_SAMPLES, [&cal](uint32_t i)
+          { sink = cal.apply(i & 0x3FFFFF); });
+
+    // The full path of a channel, with an input sweeping across the scales
+    static UMeter uMeter(USENSE_PIN, U_SCALE0_PIN, U_SCALE1_PIN);
+    uMeter.setGains(U_SCALE_DEF_GAINS);
+    Mock::setAdcSource([](uint8_t input, uint32_t index)
+                       { return testCode(index * 16); });
+    AdcSampler::init(ADC_SAMPLE_RATE);
+    constexpr uint32_t BLOCKS = BENCH_SAMPLES / ADC_BLOCK_SIZE;
+    Mock::queueAdcBlocks(BLOCKS);
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto block = AdcSampler::getBlock(); !block.empty(); block = AdcSampler::getBlock())
+        uMeter.convertBlock(block, AdcSampler::CHANNEL_COUNT);
+    auto t1 = std::chrono::steady_clock::now();
+    printf("%-28s %8.2f ns/sample (including the mock ADC), scale %d\n", "VoltMeter::convertBlock",
+           std::chrono::duration<double, std::nano>(t1 - t0).count() / (BLOCKS * ADC_BLOCK_SIZE / AdcSampler::CHANNEL_COUNT),
+           uMeter.getActiveScale());
+
+    // Console parsing, validation and dispatching, through a subcommand with typed arguments
+    uint32_t calls = 0;
+    static constexpr const char *NOP_MODES[]{"abc", "def"};
+    static constexpr Console::ArgSpec NOP_ARGS[]{
+        Console::ArgSpec::integer("count", 0, 10),
+        Console::ArgSpec::real("value", 0, 10),
+        Console::ArgSpec::choice("mode", NOP_MODES),
+    };
+    auto nopCb = [&calls](Console::Args args)
+    { calls += args.size(); };
+    const Console::Command nopSubcommands[]{
+        {"a", nullptr, 0, 0, nopCb},
+        {"run", nullptr, 3, 3, nopCb, NOP_ARGS},
+        {"z", nullptr, 0, 0, nopCb},
+    };
+    Console::Command nopCmd{"nop", "", 0, 0, {}, {}, nopSubcommands};
+    Console::registerCommand(nopCmd);
+    constexpr uint32_t COMMANDS = 100000;
+    for (uint32_t i = 0; i < COMMANDS; i++)
+        Mock::feedSerial("nop run 1 2.5 def\n");
+    t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < COMMANDS; i++)
+        Console::handleConsoleEvent(); // One command per call
+    t1 = std::chrono::steady_clock::now();
+    Mock::takeSerialOutput();
+    auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / COMMANDS;
+    printf("%-28s %8.2f ns/command, %.0f commands/s, %u args\n", "Console::handleConsoleEvent", ns, 1e9 / ns, calls);
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+// Entry of the native build: pio run -e native -t exec, or .pio/build/native/program [replay <capture> [output.csv] | scpi]
+#include <cstdio>
+#include <cstring>
+
+#include "Console.h"
+
+int runBenchmarks();
+int replay(const char *path, FILE *out);
+int runScpiPty();
+
+// The unit tests of test/ have their own
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char **argv)
+{
+    Console::init();
+
+    if (argc >= 3 && !strcmp(argv[1], "replay"))
+    {
+        FILE *out = argc >= 4 ? fopen(argv[3], "w") : stdout;
+        if (!out)
+        {
+            fprintf(stderr, "Unable to open %s\n", argv[3]);
+            return 1;
+        }
+        auto result = replay(argv[2], out);
+        if (out != stdout)
+            fclose(out);
+        return result;
+    }
+
+    if (argc == 2 && !strcmp(argv[1], "scpi"))
+        return runScpiPty();
+
+    if (argc > 1)
+    {
+        fprintf(stderr, "Usage: %s [replay <capture> [output.csv] | scpi]\n", argv[0]);
+        return 1;
+    }
+    return runBenchmarks();
+}
+#endif
@@ -0,0 +1,131 @@
+// Replay of a raw capture through the measurement code, see Capture.h
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "AdcCorrection.h"
+#include "AdcSampler.h"
+#include "Capture.h"
+#include "Meters.hpp"
+#include "config.h"
+
+/**
+ * @brief Read a record from the capture data
+ *
+ * @return false if the data ends before the record
+ */
+template <typename T>
+static bool readRecord(const std::vector<uint8_t> &data, std::size_t &pos, T &record)
+{
+    if (data.size() - pos < sizeof(T))
+        return false;
+
+    memcpy(&record, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+int replay(const char *path, FILE *out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    // The capture is saved from the serial output, so there may be some text before it
+    auto start = std::search(data.begin(), data.end(), std::begin(Capture::MAGIC), std::end(Capture::MAGIC));
+    std::size_t pos = start - data.begin();
+    Capture::Header header;
+    if (!readRecord(data, pos, header))
+    {
+        fprintf(stderr, "No capture header found\n");
+        return 1;
+    }
+    if (header.version != Capture::VERSION || header.channelCount != AdcSampler::CHANNEL_COUNT ||
+        header.blockSize != ADC_BLOCK_SIZE || header.sampleRate != ADC_SAMPLE_RATE)
+    {
+        fprintf(stderr, "Unsupported capture: version %u, %u channels, %u samples per block at %" PRIu32 " Hz\n",
+                header.version, header.channelCount, header.blockSize, header.sampleRate);
+        return 1;
+    }
+
+    // The same state as the firmware when the capture started
+    static UMeter uMeter(USENSE_PIN, U_SCALE0_PIN, U_SCALE1_PIN);
+    static IMeter iMeter(ISENSE_PIN, I_SCALE0_PIN, I_SCALE1_PIN);
+    ScaleCalibration uCals[4];
+    ScaleCalibration iCals[4];
+    Capture::getCalibrations(header, uCals, iCals);
+    for (uint8_t s = 0; s < 4; s++)
+    {
+        uMeter.setCalibration(s, uCals[s]);
+        iMeter.setCalibration(s, iCals[s]);
+    }
+    AdcCorrection::setSpikeWidths(header.spikeWidths);
+    uMeter.setAutoRange(header.flags & Capture::U_AUTO_RANGE);
+    iMeter.setAutoRange(header.flags & Capture::I_AUTO_RANGE);
+    uMeter.selectScale(header.uScale);
+    iMeter.selectScale(header.iScale);
+    uMeter.restart();
+    iMeter.restart();
+
+    uint32_t blocks = 0;
+    uint32_t gaps = 0;
+    uint32_t mismatches = 0;
+    uint32_t expected = 0;
+    bool exact = true; // Whether the state still follows the firmware
+    static Capture::BlockRecord record;
+    uint16_t block[ADC_BLOCK_SIZE];
+
+    fprintf(out, "sequence,timestamp,u_scale,i_scale,u_value,i_value\n");
+    while (pos < data.size())
+    {
+        if (data[pos] == Capture::END)
+        {
+            Capture::EndRecord end;
+            if (readRecord(data, pos, end))
+                fprintf(stderr, "End of capture: %" PRIu32 " blocks written, %" PRIu32 " dropped\n", end.blocks, end.dropped);
+            break;
+        }
+        if (data[pos] != Capture::BLOCK || !readRecord(data, pos, record))
+        {
+            fprintf(stderr, "Capture truncated or corrupted at byte %zu\n", pos);
+            break;
+        }
+
+        if (record.sequence != expected)
+        {
+            // The readings can't follow the firmware after missing blocks
+            gaps++;
+            exact = false;
+        }
+        expected = record.sequence + 1;
+
+        uint8_t uScale = record.scales & 3;
+        uint8_t iScale = record.scales >> 2 & 3;
+        if (exact && (uScale != uMeter.getActiveScale() || iScale != iMeter.getActiveScale()))
+            mismatches++;
+
+        Capture::unpack(record.codes, block);
+        uMeter.convertBlock(block, AdcSampler::CHANNEL_COUNT);
+        iMeter.convertBlock(block, AdcSampler::CHANNEL_COUNT);
+        auto uValue = uMeter.readVoltage();
+        auto iValue = iMeter.readVoltage();
+        if (exact && (uValue != record.uValue || iValue != record.iValue))
+            mismatches++;
+
+        fprintf(out, "%" PRIu32 ",%" PRIu32 ",%u,%u,%" PRId32 ",%" PRId32 "\n", record.sequence, record.timestamp,
+                uScale, iScale, uValue, iValue);
+        blocks++;
+    }
+
+    fprintf(stderr, "Replayed %" PRIu32 " blocks, %" PRIu32 " gaps, %" PRIu32 " mismatches with the recorded readings%s\n",
+            blocks, gaps, mismatches, exact ? "" : " (compared up to the first gap)");
+    return mismatches ? 2 : 0;
+}
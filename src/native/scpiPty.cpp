@@ -0,0 +1,181 @@
+// SCPI round trips over a pseudo terminal, standing in for the USB serial port of a test station
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Console.h"
+#include "Log.h"
+#include "Mock.h"
+#include "Scpi.h"
+
+/**
+ * @brief Run the console of the meter on the device side of the terminal until stopped
+ */
+static void runDevice(const int fd, std::atomic<bool> &stop)
+{
+    char buf[4096];
+    int32_t reading = 0;
+    while (!stop)
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1) > 0)
+        {
+            auto n = read(fd, buf, sizeof(buf));
+            if (n > 0)
+                Mock::feedSerial({buf, static_cast<std::size_t>(n)});
+        }
+
+        Scpi::pushReading(1234567 + reading, 456789 - reading);
+        reading = (reading + 1) % 1000;
+        Console::handleConsoleEvent();
+        Log::drain();
+
+        auto out = Mock::takeSerialOutput();
+        for (std::size_t pos = 0; pos < out.size();)
+        {
+            auto n = write(fd, out.data() + pos, out.size() - pos);
+            if (n > 0)
+                pos += n;
+        }
+    }
+}
+
+/**
+ * @brief Read a response line from the host side of the terminal
+ *
+ * @return false on a timeout
+ */
+static bool readLine(const int fd, std::string &pending, std::string &line)
+{
+    while (true)
+    {
+        auto end = pending.find('\n');
+        if (end != std::string::npos)
+        {
+            line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            return true;
+        }
+
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) <= 0)
+            return false;
+        char buf[4096];
+        auto n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            return false;
+        pending.append(buf, n);
+    }
+}
+
+static void writeAll(const int fd, const std::string &data)
+{
+    for (std::size_t pos = 0; pos < data.size();)
+    {
+        auto n = write(fd, data.data() + pos, data.size() - pos);
+        if (n > 0)
+            pos += n;
+    }
+}
+
+int runScpiPty()
+{
+    int host = posix_openpt(O_RDWR | O_NOCTTY);
+    if (host < 0 || grantpt(host) || unlockpt(host))
+    {
+        perror("Unable to open a pseudo terminal");
+        return 1;
+    }
+    int device = open(ptsname(host), O_RDWR | O_NOCTTY);
+    if (device < 0)
+    {
+        perror("Unable to open the device side of the terminal");
+        return 1;
+    }
+
+    // Raw, like the USB serial port
+    termios tio;
+    tcgetattr(device, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(device, TCSANOW, &tio);
+
+    static Scpi::Range ranges[2]{{0, true}, {0, true}};
+    Scpi::init([](Scpi::Channel channel)
+               { return ranges[static_cast<uint8_t>(channel)]; },
+               [](Scpi::Channel channel, int8_t scale)
+               {
+                   auto &range = ranges[static_cast<uint8_t>(channel)];
+                   range.autoRange = scale == Scpi::AUTO_RANGE;
+                   if (scale != Scpi::AUTO_RANGE)
+                       range.scale = scale;
+                   return true;
+               });
+
+    std::atomic<bool> stop = false;
+    std::thread deviceThread(runDevice, device, std::ref(stop));
+
+    std::string pending, line;
+    int result = 0;
+    auto check = [&](const char *query, const char *expected)
+    {
+        writeAll(host, std::string(query) + "\n");
+        if (!readLine(host, pending, line) || line.compare(0, strlen(expected), expected))
+        {
+            printf("%-28s got \"%s\", expected \"%s...\"\n", query, line.c_str(), expected);
+            result = 1;
+        }
+    };
+    check("*IDN?", SCPI_IDN);
+    check("conf:rang:volt 2;volt?;:CONF:RANG:VOLT:AUTO?", "2;0");
+    check("SENS:AVER:COUN 99;:SYST:ERR?;ERR?", "-222,\"Data out of range\";0,\"No error\"");
+    check("MEAS:FOO?;:SYST:ERR?", "-113,");
+
+    // One query at a time
+    constexpr uint32_t ROUND_TRIPS = 20000;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ROUND_TRIPS && !result; i++)
+    {
+        writeAll(host, "MEAS:VOLT?\n");
+        if (!readLine(host, pending, line))
+            result = 1;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    printf("%-28s %8.0f round trips/s\n", "Sequential MEAS:VOLT?",
+           ROUND_TRIPS / std::chrono::duration<double>(t1 - t0).count());
+
+    // Batches of chained queries written before reading the responses
+    constexpr uint32_t BATCH = 32;
+    std::string batch;
+    for (uint32_t i = 0; i < BATCH; i++)
+        batch += "MEAS:VOLT?;CURR?\n";
+    t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ROUND_TRIPS / BATCH && !result; i++)
+    {
+        writeAll(host, batch);
+        for (uint32_t j = 0; j < BATCH && !result; j++)
+        {
+            if (!readLine(host, pending, line))
+                result = 1;
+        }
+    }
+    t1 = std::chrono::steady_clock::now();
+    printf("%-28s %8.0f round trips/s, 2 queries each\n", "Pipelined MEAS:VOLT?;CURR?",
+           ROUND_TRIPS / BATCH * BATCH / std::chrono::duration<double>(t1 - t0).count());
+    printf("Last response: %s\n", line.c_str());
+
+    stop = true;
+    deviceThread.join();
+    close(device);
+    close(host);
+    if (result)
+        printf("SCPI over the pty: FAILED\n");
+    return result;
+}
@@ -0,0 +1,127 @@
+// The calibration of a scale, from a single point to the full table
+#include <unity.h>
+
+#include "Calibration.hpp"
+#include "FixedPoint.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_empty()
+{
+    ScaleCalibration cal;
+    TEST_ASSERT_EQUAL_UINT8(0, cal.getCount());
+    TEST_ASSERT_EQUAL_UINT32(0, cal.gain());
+    TEST_ASSERT_EQUAL_INT32(FixedPoint::INVALID, cal.apply(1000000));
+}
+
+static void test_one_point()
+{
+    ScaleCalibration cal;
+    TEST_ASSERT_EQUAL_UINT8(0, cal.addPoint(1000000, 2000000));
+    TEST_ASSERT_EQUAL_UINT32(FixedPoint::ONE / 2, cal.gain());
+
+    // Gain only, through zero
+    TEST_ASSERT_EQUAL_INT32(1000000, cal.apply(500000));
+    TEST_ASSERT_EQUAL_INT32(0, cal.apply(0));
+    TEST_ASSERT_EQUAL_INT32(6000000, cal.apply(3000000));
+}
+
+static void test_set_gain()
+{
+    ScaleCalibration cal;
+    cal.setGain(2 * FixedPoint::ONE);
+    TEST_ASSERT_EQUAL_UINT8(1, cal.getCount());
+    TEST_ASSERT_EQUAL_UINT32(2 * FixedPoint::ONE, cal.gain());
+    TEST_ASSERT_EQUAL_INT32(500000, cal.apply(1000000));
+
+    cal.setGain(0);
+    TEST_ASSERT_EQUAL_INT32(FixedPoint::INVALID, cal.apply(1000000));
+}
+
+static void test_two_points()
+{
+    ScaleCalibration cal;
+    cal.addPoint(1100000, 2000000);
+    TEST_ASSERT_EQUAL_UINT8(0, cal.addPoint(100000, 0)); // Sorted before the first one
+    TEST_ASSERT_EQUAL_UINT32(FixedPoint::ONE / 2, cal.gain());
+
+    // The offset is covered
+    TEST_ASSERT_EQUAL_INT32(0, cal.apply(100000));
+    TEST_ASSERT_EQUAL_INT32(1000000, cal.apply(600000));
+
+    // Extrapolated on both sides
+    TEST_ASSERT_EQUAL_INT32(4000000, cal.apply(2100000));
+    TEST_ASSERT_EQUAL_INT32(-200000, cal.apply(0));
+}
+
+static void test_three_points()
+{
+    ScaleCalibration cal;
+    cal.addPoint(100000, 0);
+    cal.addPoint(2100000, 5000000);
+    TEST_ASSERT_EQUAL_UINT8(1, cal.addPoint(1100000, 2000000));
+    TEST_ASSERT_EQUAL_UINT8(3, cal.getCount());
+    TEST_ASSERT_EQUAL_UINT32(100000, cal.getPoint(0).raw);
+    TEST_ASSERT_EQUAL_UINT32(1100000, cal.getPoint(1).raw);
+    TEST_ASSERT_EQUAL_UINT32(2100000, cal.getPoint(2).raw);
+
+    // Between the outer points
+    TEST_ASSERT_EQUAL_UINT32(FixedPoint::ONE * 2 / 5, cal.gain());
+
+    // Piecewise linear
+    TEST_ASSERT_EQUAL_INT32(1000000, cal.apply(600000));
+    TEST_ASSERT_EQUAL_INT32(2000000, cal.apply(1100000));
+    TEST_ASSERT_EQUAL_INT32(3500000, cal.apply(1600000));
+    TEST_ASSERT_EQUAL_INT32(6500000, cal.apply(2600000)); // The last segment extrapolated
+}
+
+static void test_four_points()
+{
+    ScaleCalibration cal;
+    cal.addPoint(100000, 0);
+    cal.addPoint(1100000, 2000000);
+    cal.addPoint(2100000, 5000000);
+    TEST_ASSERT_EQUAL_UINT8(3, cal.addPoint(3100000, 6000000));
+    TEST_ASSERT_EQUAL_UINT8(ScaleCalibration::MAX_POINTS, cal.getCount());
+    TEST_ASSERT_EQUAL_INT32(5500000, cal.apply(2600000));
+
+    // Full, so the nearest point is replaced
+    TEST_ASSERT_EQUAL_UINT8(2, cal.addPoint(2000000, 3800000));
+    TEST_ASSERT_EQUAL_UINT8(ScaleCalibration::MAX_POINTS, cal.getCount());
+    TEST_ASSERT_EQUAL_UINT32(2000000, cal.getPoint(2).raw);
+    TEST_ASSERT_EQUAL_INT32(2900000, cal.apply(1550000));
+}
+
+static void test_close_point_replaced()
+{
+    ScaleCalibration cal;
+    cal.addPoint(100000, 0);
+    cal.addPoint(1100000, 2000000);
+
+    // Closer than MIN_SPACING
+    cal.addPoint(1100000 + ScaleCalibration::MIN_SPACING - 1, 3000000);
+    TEST_ASSERT_EQUAL_UINT8(2, cal.getCount());
+    TEST_ASSERT_EQUAL_INT32(3000000, cal.getPoint(1).value);
+
+    cal.addPoint(1100000 + 2 * ScaleCalibration::MIN_SPACING, 3000000);
+    TEST_ASSERT_EQUAL_UINT8(3, cal.getCount());
+
+    cal.clear();
+    TEST_ASSERT_EQUAL_UINT8(0, cal.getCount());
+    TEST_ASSERT_EQUAL_INT32(FixedPoint::INVALID, cal.apply(1000000));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_one_point);
+    RUN_TEST(test_set_gain);
+    RUN_TEST(test_two_points);
+    RUN_TEST(test_three_points);
+    RUN_TEST(test_four_points);
+    RUN_TEST(test_close_point_replaced);
+    return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// The parsing, validation and dispatching of the console commands, through the mock serial port
+#include <string>
+#include <unity.h>
+
+#include "Console.h"
+#include "Mock.h"
+#include "config.h"
+
+static uint32_t calls;
+static long lastInt;
+static float lastReal;
+static uint8_t lastChoice;
+
+static constexpr const char *MODES[]{"a", "b"};
+static constexpr Console::ArgSpec INT_ARGS[]{Console::ArgSpec::integer("count", 0, 10)};
+static constexpr Console::ArgSpec REAL_ARGS[]{Console::ArgSpec::real("level", 0, 1)};
+static constexpr Console::ArgSpec MODE_ARGS[]{Console::ArgSpec::choice("mode", MODES)};
+
+static const Console::Command TST_SUBCOMMANDS[]{
+    {"int", nullptr, 1, 1, [](Console::Args args)
+     { calls++; lastInt = args[2].toInt(); }, INT_ARGS},
+    {"mode", nullptr, 1, 1, [](Console::Args args)
+     { calls++; lastChoice = args[2].getChoice(); }, MODE_ARGS},
+    {"real", nullptr, 1, 1, [](Console::Args args)
+     { calls++; lastReal = args[2].toFloat(); }, REAL_ARGS},
+    {"text", nullptr, 0, CONSOLE_MAX_ARGS, [](Console::Args args)
+     { calls++; }},
+};
+
+/** Run a line through the console, and get what it wrote back */
+static std::string run(const char *line)
+{
+    Mock::feedSerial(line);
+    Mock::feedSerial("\n");
+    Console::handleConsoleEvent(); // One command per call
+    return Mock::takeSerialOutput();
+}
+
+static bool contains(const std::string &output, const char *text)
+{
+    return output.find(text) != std::string::npos;
+}
+
+void setUp()
+{
+    calls = 0;
+}
+
+void tearDown() {}
+
+static void test_valid_arguments()
+{
+    run("tst int 5");
+    TEST_ASSERT_EQUAL_UINT32(1, calls);
+    TEST_ASSERT_EQUAL_INT32(5, lastInt);
+
+    run("tst real 0.25");
+    TEST_ASSERT_EQUAL_UINT32(2, calls);
+    TEST_ASSERT_TRUE(lastReal == 0.25f);
+
+    run("  tst   mode b");
+    TEST_ASSERT_EQUAL_UINT32(3, calls);
+    TEST_ASSERT_EQUAL_UINT8(1, lastChoice);
+}
+
+static void test_rejected_int()
+{
+    auto output = run("tst int 11");
+    TEST_ASSERT_EQUAL_UINT32(0, calls);
+    TEST_ASSERT_TRUE(contains(output, "Invalid count: 11, an integer from 0 to 10"));
+
+    output = run("tst int 5x");
+    TEST_ASSERT_EQUAL_UINT32(0, calls);
+    TEST_ASSERT_TRUE(contains(output, "Invalid count: 5x"));
+}
+
+static void test_rejected_float()
+{
+    auto output = run("tst real 1.5");
+    TEST_ASSERT_EQUAL_UINT32(0, calls);
+    TEST_ASSERT_TRUE(contains(output, "Invalid level: 1.5, a number from 0 to 1"));
+}
+
+static void test_rejected_choice()
+{
+    auto output = run("tst mode c");
+    TEST_ASSERT_EQUAL_UINT32(0, calls);
+    TEST_ASSERT_TRUE(contains(output, "Invalid mode: c, one of a|b"));
+}
+
+static void test_unknown_command()
+{
+    auto output = run("nope");
+    TEST_ASSERT_TRUE(contains(output, "Unknown command: nope, try 'help'"));
+
+    output = run("tst foo");
+    TEST_ASSERT_EQUAL_UINT32(0, calls);
+    TEST_ASSERT_TRUE(contains(output, "Unknown subcommand of tst: foo"));
+}
+
+static void test_argument_count()
+{
+    auto output = run("tst int");
+    TEST_ASSERT_EQUAL_UINT32(0, calls);
+    TEST_ASSERT_TRUE(contains(output, "Invalid argument count for command: int"));
+
+    output = run("tst int 1 2");
+    TEST_ASSERT_EQUAL_UINT32(0, calls);
+    TEST_ASSERT_TRUE(contains(output, "Invalid argument count for command: int"));
+}
+
+static void test_too_many_arguments()
+{
+    // CONSOLE_MAX_ARGS tokens including the command name
+    run("tst text 1 2 3 4 5 6");
+    TEST_ASSERT_EQUAL_UINT32(1, calls);
+
+    auto output = run("tst text 1 2 3 4 5 6 7");
+    TEST_ASSERT_EQUAL_UINT32(1, calls);
+    TEST_ASSERT_TRUE(contains(output, "Too many arguments, at most 8"));
+}
+
+int main(int argc, char **argv)
+{
+    Console::init();
+    Console::registerCommand({"tst", "Unit test", 0, 0, {}, {}, TST_SUBCOMMANDS});
+    Mock::takeSerialOutput();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_arguments);
+    RUN_TEST(test_rejected_int);
+    RUN_TEST(test_rejected_float);
+    RUN_TEST(test_rejected_choice);
+    RUN_TEST(test_unknown_command);
+    RUN_TEST(test_argument_count);
+    RUN_TEST(test_too_many_arguments);
+    return UNITY_END();
+}
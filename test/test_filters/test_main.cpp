@@ -0,0 +1,190 @@
+// The outputs of the filters after a known input, and after a scale change
+#include <unity.h>
+
+#include "Filters.hpp"
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_boxcar_mean()
+{
+    BoxcarFilter<4> filter;
+    TEST_ASSERT_EQUAL_UINT32(0, filter.mean());
+
+    filter.push(100);
+    filter.push(200);
+    TEST_ASSERT_FALSE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(150 << 16, filter.mean()); // Of the samples so far
+
+    filter.push(300);
+    filter.push(400);
+    TEST_ASSERT_TRUE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(250 << 16, filter.mean());
+
+    filter.push(500); // The oldest one drops out
+    TEST_ASSERT_EQUAL_UINT32(350 << 16, filter.mean());
+
+    filter.reset();
+    TEST_ASSERT_FALSE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(0, filter.mean());
+}
+
+static void test_boxcar_rescale()
+{
+    BoxcarFilter<5> filter;
+    for (uint16_t v : {100, 200, 300, 400, 500})
+        filter.push(v);
+    TEST_ASSERT_UINT32_WITHIN(1, 300 << 16, filter.mean());
+
+    filter.rescale(2 << 16);
+    TEST_ASSERT_TRUE(filter.ready());
+    TEST_ASSERT_UINT32_WITHIN(1, 600 << 16, filter.mean());
+
+    filter.push(1200); // Replaces the rescaled 100
+    TEST_ASSERT_UINT32_WITHIN(1, 800 << 16, filter.mean());
+
+    filter.rescale(1 << 15);
+    TEST_ASSERT_UINT32_WITHIN(1, 400 << 16, filter.mean());
+}
+
+static void test_rescale_large_ratio()
+{
+    // Past the 32-bit products and the Q16.16 state, clamped to the sample range
+    constexpr uint32_t RATIO = 40 << 16;
+
+    BoxcarFilter<4> boxcar;
+    for (uint16_t v : {1000, 2000, 3000, 4000})
+        boxcar.push(v);
+    boxcar.rescale(RATIO);
+    TEST_ASSERT_EQUAL_UINT32(static_cast<uint32_t>(40000 + 65535 * 3) << 14, boxcar.mean());
+
+    EmaFilter<4> ema;
+    ema.push(3500);
+    ema.rescale(RATIO);
+    TEST_ASSERT_EQUAL_UINT32(INT32_MAX, ema.mean());
+
+    MedianFilter<3> median;
+    for (uint16_t v : {1000, 2000, 3000})
+        median.push(v);
+    median.rescale(RATIO);
+    TEST_ASSERT_EQUAL_UINT32(static_cast<uint32_t>(UINT16_MAX) << 16, median.mean());
+}
+
+static void test_ema_mean()
+{
+    EmaFilter<4> filter;
+    filter.push(1000); // Seeds the state
+    TEST_ASSERT_EQUAL_UINT32(1000 << 16, filter.mean());
+
+    filter.push(2000);
+    TEST_ASSERT_EQUAL_UINT32(1250 << 16, filter.mean());
+    TEST_ASSERT_FALSE(filter.ready());
+
+    filter.push(2000);
+    filter.push(2000);
+    TEST_ASSERT_TRUE(filter.ready());
+
+    filter.reset();
+    filter.push(3000);
+    TEST_ASSERT_EQUAL_UINT32(3000 << 16, filter.mean());
+}
+
+static void test_ema_rescale()
+{
+    EmaFilter<4> filter;
+    filter.push(1000);
+    filter.push(2000);
+    filter.rescale(1 << 15);
+    TEST_ASSERT_EQUAL_UINT32(625 << 16, filter.mean());
+
+    filter.rescale(4 << 16);
+    TEST_ASSERT_EQUAL_UINT32(2500 << 16, filter.mean());
+}
+
+static void test_median_mean()
+{
+    MedianFilter<5> filter;
+    for (uint16_t v : {10, 1000, 12})
+        filter.push(v);
+    TEST_ASSERT_FALSE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(12 << 16, filter.mean());
+
+    filter.push(11);
+    filter.push(13);
+    TEST_ASSERT_TRUE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(12 << 16, filter.mean()); // The spike is rejected
+
+    filter.push(2000); // Replaces the 10
+    filter.push(2000); // Replaces the 1000
+    TEST_ASSERT_EQUAL_UINT32(13 << 16, filter.mean());
+}
+
+static void test_median_rescale()
+{
+    MedianFilter<5> filter;
+    for (uint16_t v : {10, 1000, 12, 11, 13})
+        filter.push(v);
+    filter.rescale(2 << 16);
+    TEST_ASSERT_EQUAL_UINT32(24 << 16, filter.mean());
+
+    filter.push(1); // Replaces the rescaled 20
+    TEST_ASSERT_EQUAL_UINT32(24 << 16, filter.mean());
+}
+
+static void test_cic_mean()
+{
+    CicFilter<4, 2> filter;
+    for (int i = 0; i < 4; i++)
+        filter.push(1000);
+    TEST_ASSERT_FALSE(filter.ready()); // The combs still hold the initial state
+
+    for (int i = 0; i < 4; i++)
+        filter.push(1000);
+    TEST_ASSERT_TRUE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(1000 << 16, filter.mean());
+
+    // A step settles after ORDER decimations
+    for (int i = 0; i < 8; i++)
+        filter.push(3000);
+    TEST_ASSERT_EQUAL_UINT32(3000 << 16, filter.mean());
+}
+
+static void test_cic_wide()
+{
+    CicFilter<64> filter; // GAIN_BITS above 16
+    for (int i = 0; i < 3 * 64; i++)
+        filter.push(4095);
+    TEST_ASSERT_TRUE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(4095 << 16, filter.mean());
+}
+
+static void test_cic_rescale()
+{
+    CicFilter<4, 2> filter;
+    for (int i = 0; i < 8; i++)
+        filter.push(1000);
+    filter.rescale(2 << 16); // Starts over
+    TEST_ASSERT_FALSE(filter.ready());
+
+    for (int i = 0; i < 8; i++)
+        filter.push(2000);
+    TEST_ASSERT_TRUE(filter.ready());
+    TEST_ASSERT_EQUAL_UINT32(2000 << 16, filter.mean());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boxcar_mean);
+    RUN_TEST(test_boxcar_rescale);
+    RUN_TEST(test_rescale_large_ratio);
+    RUN_TEST(test_ema_mean);
+    RUN_TEST(test_ema_rescale);
+    RUN_TEST(test_median_mean);
+    RUN_TEST(test_median_rescale);
+    RUN_TEST(test_cic_mean);
+    RUN_TEST(test_cic_wide);
+    RUN_TEST(test_cic_rescale);
+    return UNITY_END();
+}
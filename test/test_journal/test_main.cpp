@@ -0,0 +1,108 @@
+// The records of the journal in the mock storage, across reboots and wraps of the sector ring
+#include <cstring>
+#include <unity.h>
+
+#include "Hal.h"
+#include "Journal.h"
+
+constexpr std::size_t HEADER_SIZE = 16;
+constexpr std::size_t MAX_PAYLOAD = Hal::STORAGE_SECTOR_SIZE - HEADER_SIZE;
+
+static uint8_t payload[Hal::STORAGE_SECTOR_SIZE];
+static uint8_t readBack[Hal::STORAGE_SECTOR_SIZE];
+static uint32_t erases;
+
+static void fill(const std::size_t len, const uint8_t seed)
+{
+    for (std::size_t i = 0; i < len; i++)
+        payload[i] = seed + i * 7;
+}
+
+/** Whether the latest record is the payload, as found after a reboot */
+static bool latestIs(const uint16_t version, const std::size_t len)
+{
+    uint16_t readVersion = 0;
+    memset(readBack, 0, sizeof(readBack));
+    return Journal::init() && Journal::readLatest(readVersion, readBack, sizeof(readBack)) == len &&
+           readVersion == version && !memcmp(readBack, payload, len);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_empty()
+{
+    uint16_t version;
+    TEST_ASSERT_TRUE(Journal::init());
+    TEST_ASSERT_EQUAL_size_t(0, Journal::readLatest(version, readBack, sizeof(readBack)));
+}
+
+static void test_record_sizes()
+{
+    Journal::CommitStats stats;
+    fill(10, 1);
+    TEST_ASSERT_TRUE(Journal::append(1, payload, 10, stats));
+    TEST_ASSERT_EQUAL_UINT8(1, stats.pages);
+    TEST_ASSERT_TRUE(latestIs(1, 10));
+
+    // Over several pages
+    fill(600, 2);
+    TEST_ASSERT_TRUE(Journal::append(2, payload, 600, stats));
+    TEST_ASSERT_EQUAL_UINT8(3, stats.pages);
+    TEST_ASSERT_TRUE(latestIs(2, 600));
+
+    // Shorter again, and cut to the room of the reader
+    fill(20, 3);
+    TEST_ASSERT_TRUE(Journal::append(3, payload, 20, stats));
+    uint16_t version;
+    memset(readBack, 0, sizeof(readBack));
+    TEST_ASSERT_EQUAL_size_t(20, Journal::readLatest(version, readBack, 8));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(readBack, payload, 8));
+    TEST_ASSERT_EQUAL_UINT8(0, readBack[8]);
+}
+
+static void test_too_large()
+{
+    Journal::CommitStats stats;
+    fill(MAX_PAYLOAD, 4);
+    TEST_ASSERT_TRUE(Journal::append(4, payload, MAX_PAYLOAD, stats));
+    TEST_ASSERT_TRUE(latestIs(4, MAX_PAYLOAD));
+
+    // Records don't cross the sectors, the previous one stays the latest
+    TEST_ASSERT_FALSE(Journal::append(5, payload, MAX_PAYLOAD + 1, stats));
+    TEST_ASSERT_TRUE(latestIs(4, MAX_PAYLOAD));
+}
+
+static void test_wrap()
+{
+    Journal::setEraseHooks([]
+                           { erases++; }, nullptr);
+
+    // Enough commits for the ring to wrap around the sectors a few times, each one found again after a reboot
+    constexpr uint16_t COMMITS = 100;
+    uint32_t erased = 0;
+    for (uint16_t i = 0; i < COMMITS; i++)
+    {
+        Journal::CommitStats stats;
+        fill(300, i);
+        TEST_ASSERT_TRUE(Journal::append(i, payload, 300, stats));
+        TEST_ASSERT_TRUE(latestIs(i, 300));
+        erased += stats.erased;
+    }
+
+    // 2 pages a record, 8 records a sector
+    TEST_ASSERT_TRUE(erased >= COMMITS / 8 - 1);
+    TEST_ASSERT_EQUAL_UINT32(erased, erases);
+    Journal::setEraseHooks(nullptr, nullptr);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_record_sizes);
+    RUN_TEST(test_too_large);
+    RUN_TEST(test_wrap);
+    return UNITY_END();
+}
@@ -0,0 +1,99 @@
+// The automatic scale selection of VoltMeter, from the peak codes of the blocks
+#include <unity.h>
+
+#include "FixedPoint.hpp"
+#include "Meters.hpp"
+#include "Mock.h"
+#include "config.h"
+
+static UMeter *meter;
+
+/** The scale set on the pins, lower bit on U_SCALE0_PIN */
+static uint8_t pinScale()
+{
+    auto levels = Mock::getPinLevels();
+    return ((levels >> U_SCALE0_PIN) & 1) | (((levels >> U_SCALE1_PIN) & 1) << 1);
+}
+
+void setUp()
+{
+    static UMeter instance(USENSE_PIN, U_SCALE0_PIN, U_SCALE1_PIN);
+    meter = &instance;
+    meter->setGains(U_SCALE_DEF_GAINS);
+    meter->setAutoRange(true);
+    meter->selectScale(0, true);
+}
+
+void tearDown() {}
+
+static void test_up_to_highest_gain()
+{
+    // Under RANGE_ENTER_CODE even with the highest gain
+    meter->updateRange(300);
+    TEST_ASSERT_EQUAL_UINT8(3, meter->getActiveScale());
+    TEST_ASSERT_EQUAL_UINT8(3, pinScale());
+}
+
+static void test_up_to_middle_gain()
+{
+    // 1000 * 0.45 / 0.23 stays under RANGE_ENTER_CODE, 1000 * 1 / 0.23 doesn't
+    meter->updateRange(1000);
+    TEST_ASSERT_EQUAL_UINT8(1, meter->getActiveScale());
+    TEST_ASSERT_EQUAL_UINT8(1, pinScale());
+
+    // Settled on it
+    meter->updateRange(1000 * 0.45 / 0.23);
+    TEST_ASSERT_EQUAL_UINT8(1, meter->getActiveScale());
+}
+
+static void test_hysteresis()
+{
+    meter->updateRange(300);
+    TEST_ASSERT_EQUAL_UINT8(3, meter->getActiveScale());
+
+    // Above RANGE_ENTER_CODE but below RANGE_LEAVE_CODE
+    meter->updateRange(3800);
+    TEST_ASSERT_EQUAL_UINT8(3, meter->getActiveScale());
+}
+
+static void test_down()
+{
+    meter->updateRange(300);
+    meter->updateRange(3950);
+    TEST_ASSERT_EQUAL_UINT8(2, meter->getActiveScale());
+    TEST_ASSERT_EQUAL_UINT8(2, pinScale());
+}
+
+static void test_saturation()
+{
+    meter->updateRange(300);
+    meter->updateRange(3950);
+    TEST_ASSERT_EQUAL_UINT8(2, meter->getActiveScale());
+
+    // Straight to the lowest gain, not overloaded yet
+    meter->updateRange(4090);
+    TEST_ASSERT_EQUAL_UINT8(0, meter->getActiveScale());
+    TEST_ASSERT_EQUAL_UINT8(0, pinScale());
+    TEST_ASSERT_EQUAL_INT32(FixedPoint::INVALID, meter->readVoltage()); // The filter was reset
+
+    // Saturated on the lowest gain
+    meter->updateRange(4090);
+    TEST_ASSERT_EQUAL_UINT8(0, meter->getActiveScale());
+    TEST_ASSERT_EQUAL_INT32(FixedPoint::OVERLOAD, meter->readVoltage());
+
+    // Until a peak below the saturation
+    meter->updateRange(3000);
+    TEST_ASSERT_EQUAL_UINT8(0, meter->getActiveScale());
+    TEST_ASSERT_EQUAL_INT32(FixedPoint::INVALID, meter->readVoltage());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_up_to_highest_gain);
+    RUN_TEST(test_up_to_middle_gain);
+    RUN_TEST(test_hysteresis);
+    RUN_TEST(test_down);
+    RUN_TEST(test_saturation);
+    return UNITY_END();
+}
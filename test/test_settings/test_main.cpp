@@ -0,0 +1,82 @@
+// The settings committed to the mock storage and loaded back
+#include <unity.h>
+
+#include "AdcCorrection.h"
+#include "Calibration.hpp"
+#include "FixedPoint.hpp"
+#include "Settings.h"
+#include "config.h"
+
+static ScaleCalibration uCals[4], iCals[4], uLoaded[4], iLoaded[4];
+static int16_t widths[AdcCorrection::SPIKE_COUNT]{16, 24, 8, 32};
+static int16_t loadedWidths[AdcCorrection::SPIKE_COUNT];
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_defaults()
+{
+    // Nothing stored yet
+    Settings::load(uLoaded, iLoaded, loadedWidths);
+    for (uint8_t s = 0; s < 4; s++)
+    {
+        ScaleCalibration u, i;
+        u.setGain(FixedPoint::toQ16(U_SCALE_DEF_GAINS[s]));
+        i.setGain(FixedPoint::toQ16(I_SCALE_DEF_GAIN[s]));
+        TEST_ASSERT_EQUAL_UINT8(1, uLoaded[s].getCount());
+        TEST_ASSERT_EQUAL_UINT32(u.gain(), uLoaded[s].gain());
+        TEST_ASSERT_EQUAL_UINT32(i.gain(), iLoaded[s].gain());
+    }
+}
+
+static void test_round_trip()
+{
+    for (uint8_t s = 0; s < 4; s++)
+    {
+        uCals[s].clear();
+        uCals[s].addPoint(20000, 0);
+        uCals[s].addPoint(1500000, 6500000 - s * 1000000);
+        uCals[s].addPoint(3000000, 13100000 - s * 2000000);
+        iCals[s].setGain(FixedPoint::toQ16(I_SCALE_DEF_GAIN[s]));
+    }
+    TEST_ASSERT_TRUE(Settings::save(uCals, iCals, widths));
+
+    Settings::load(uLoaded, iLoaded, loadedWidths);
+    for (uint8_t s = 0; s < 4; s++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(uCals[s].getCount(), uLoaded[s].getCount());
+        for (uint8_t i = 0; i < uCals[s].getCount(); i++)
+        {
+            TEST_ASSERT_EQUAL_UINT32(uCals[s].getPoint(i).raw, uLoaded[s].getPoint(i).raw);
+            TEST_ASSERT_EQUAL_INT32(uCals[s].getPoint(i).value, uLoaded[s].getPoint(i).value);
+        }
+        TEST_ASSERT_EQUAL_INT32(uCals[s].apply(1000000), uLoaded[s].apply(1000000));
+        TEST_ASSERT_EQUAL_UINT32(iCals[s].gain(), iLoaded[s].gain());
+    }
+    for (uint8_t i = 0; i < AdcCorrection::SPIKE_COUNT; i++)
+        TEST_ASSERT_EQUAL_INT32(widths[i], loadedWidths[i]);
+}
+
+static void test_many_commits()
+{
+    // Enough commits for the journal to wrap around the sectors a few times, each one found again after a reboot
+    constexpr uint32_t COMMITS = 100;
+    for (uint32_t i = 0; i < COMMITS; i++)
+    {
+        iCals[1].setGain(FixedPoint::toQ16(1.0f + i / 1000.0f));
+        TEST_ASSERT_TRUE(Settings::save(uCals, iCals, widths));
+        Settings::load(uLoaded, iLoaded, loadedWidths);
+        TEST_ASSERT_EQUAL_UINT32(iCals[1].gain(), iLoaded[1].gain());
+        TEST_ASSERT_EQUAL_INT32(uCals[3].apply(1000000), uLoaded[3].apply(1000000));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_defaults);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_many_commits);
+    return UNITY_END();
+}